@@ -0,0 +1,462 @@
+﻿#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <NVI/Codec.h>
+#include "Codec.h"
+#include "adaption/Clock.h"
+
+/*
+ * x2645_bench: 按编码器、分辨率、像素格式、Slice模式、线程数的组合逐项测试编码性能，
+ * 每个组合输出一行JSON到stdout，便于脚本收集和对比。
+ *
+ * x2645_bench [--codec avc,hevc] [--size 1920x1080,3840x2160] [--format i420,nv12,nv21,422p,uyvy,yuy2]
+ *             [--slice 0,1] [--threads 0,4,8] [--tuning latency,throughput,parallel] [--frames 600]
+ *             [--fps 30] [--bitrate 8000] [--gop 60] [--input file.yuv]
+ *
+ * --input指定原始YUV文件时，所有组合只能使用一种分辨率和像素格式，文件最多预读kPreloadFrames帧循环编码；
+ * 不指定时使用运动的合成图像。
+ */
+
+namespace
+{
+const size_t kPreloadFrames = 64;
+
+struct BenchOptions
+{
+    std::vector<uint32_t> vecCodecs{NVICodec_AVC};
+    std::vector<std::pair<uint32_t, uint32_t>> vecSizes{{1920u, 1080u}};
+    std::vector<std::string> vecFormats{"i420"};
+    std::vector<uint16_t> vecSliceModes{0u};
+    std::vector<uint32_t> vecThreads{0u};
+    std::vector<uint32_t> vecTunings{X2645Tuning_ZeroLatency};
+    uint32_t uFrames = 600u;
+    uint32_t uFps = 30u;
+    uint32_t uBitrate = 8000u;
+    uint32_t uGop = 60u;
+    std::string strInput;
+};
+
+struct FormatLayout
+{
+    NVIPixelFormat format;
+    uint32_t uPlanes;
+    uint32_t uStrides[3];
+    uint32_t uHeights[3];
+};
+
+struct FrameTiming
+{
+    int64_t nSubmit;
+    int64_t nFirst;
+    int64_t nLast;
+};
+
+struct BenchContext
+{
+    std::vector<FrameTiming> vecTimings;
+    uint64_t uBytes = 0u;
+    uint64_t uPackets = 0u;
+};
+
+std::vector<std::string> Split(const std::string& str, char delimiter)
+{
+    std::vector<std::string> vecItems;
+    size_t szBegin = 0u;
+    while (szBegin <= str.size())
+    {
+        size_t szEnd = str.find(delimiter, szBegin);
+        if (szEnd == std::string::npos)
+        {
+            szEnd = str.size();
+        }
+        if (szEnd > szBegin)
+        {
+            vecItems.emplace_back(str.substr(szBegin, szEnd - szBegin));
+        }
+        szBegin = szEnd + 1;
+    }
+    return vecItems;
+}
+
+bool ParseOptions(int argc, char* argv[], BenchOptions& options)
+{
+    // 参数成对出现，缺少值的选项视为错误
+    if (argc % 2 == 0)
+    {
+        return false;
+    }
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string strKey = argv[i];
+        const std::string strValue = argv[i + 1];
+        const std::vector<std::string> vecItems = Split(strValue, ',');
+        if (strKey == "--codec")
+        {
+            options.vecCodecs.clear();
+            for (const std::string& item : vecItems)
+            {
+                options.vecCodecs.push_back(item == "hevc" ? NVICodec_HEVC : NVICodec_AVC);
+            }
+        }
+        else if (strKey == "--size")
+        {
+            options.vecSizes.clear();
+            for (const std::string& item : vecItems)
+            {
+                uint32_t uWidth = 0u;
+                uint32_t uHeight = 0u;
+                if (sscanf(item.c_str(), "%ux%u", &uWidth, &uHeight) != 2 || uWidth == 0u || uHeight == 0u)
+                {
+                    return false;
+                }
+                options.vecSizes.emplace_back(uWidth, uHeight);
+            }
+        }
+        else if (strKey == "--format")
+        {
+            options.vecFormats = vecItems;
+        }
+        else if (strKey == "--slice")
+        {
+            options.vecSliceModes.clear();
+            for (const std::string& item : vecItems)
+            {
+                options.vecSliceModes.push_back(static_cast<uint16_t>(std::atoi(item.c_str()) != 0 ? NVISliceMode_MultiSlice : 0));
+            }
+        }
+        else if (strKey == "--threads")
+        {
+            options.vecThreads.clear();
+            for (const std::string& item : vecItems)
+            {
+                options.vecThreads.push_back(static_cast<uint32_t>(std::atoi(item.c_str())));
+            }
+        }
+        else if (strKey == "--tuning")
+        {
+            options.vecTunings.clear();
+            for (const std::string& item : vecItems)
+            {
+                options.vecTunings.push_back(item == "throughput" ? X2645Tuning_Throughput
+                                             : item == "parallel" ? X2645Tuning_Parallel
+                                                                  : X2645Tuning_ZeroLatency);
+            }
+        }
+        else if (strKey == "--frames")
+        {
+            options.uFrames = static_cast<uint32_t>(std::atoi(strValue.c_str()));
+        }
+        else if (strKey == "--fps")
+        {
+            options.uFps = static_cast<uint32_t>(std::atoi(strValue.c_str()));
+        }
+        else if (strKey == "--bitrate")
+        {
+            options.uBitrate = static_cast<uint32_t>(std::atoi(strValue.c_str()));
+        }
+        else if (strKey == "--gop")
+        {
+            options.uGop = static_cast<uint32_t>(std::atoi(strValue.c_str()));
+        }
+        else if (strKey == "--input")
+        {
+            options.strInput = strValue;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return options.uFrames > 0u && options.uFps > 0u && !options.vecCodecs.empty() && !options.vecSizes.empty() && !options.vecFormats.empty() &&
+           !options.vecSliceModes.empty() && !options.vecThreads.empty() && !options.vecTunings.empty();
+}
+
+bool MakeLayout(const std::string& name, uint32_t width, uint32_t height, FormatLayout& layout)
+{
+    layout = {};
+    if (name == "i420" || name == "nv12" || name == "nv21")
+    {
+        const bool bPlanar = name == "i420";
+        layout.format = bPlanar ? NVIPixel_I420 : (name == "nv12" ? NVIPixel_NV12 : NVIPixel_NV21);
+        layout.uPlanes = bPlanar ? 3u : 2u;
+        layout.uStrides[0] = width;
+        layout.uStrides[1] = bPlanar ? width / 2 : width;
+        layout.uStrides[2] = width / 2;
+        layout.uHeights[0] = height;
+        layout.uHeights[1] = height / 2;
+        layout.uHeights[2] = height / 2;
+    }
+    else if (name == "422p")
+    {
+        layout.format = NVIPixel_422P;
+        layout.uPlanes = 3u;
+        layout.uStrides[0] = width;
+        layout.uStrides[1] = width / 2;
+        layout.uStrides[2] = width / 2;
+        layout.uHeights[0] = height;
+        layout.uHeights[1] = height;
+        layout.uHeights[2] = height;
+    }
+    else if (name == "uyvy" || name == "yuy2")
+    {
+        layout.format = name == "uyvy" ? NVIPixel_UYVY : NVIPixel_YUY2;
+        layout.uPlanes = 1u;
+        layout.uStrides[0] = width * 2;
+        layout.uHeights[0] = height;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+size_t FrameBytes(const FormatLayout& layout)
+{
+    size_t szBytes = 0u;
+    for (uint32_t i = 0; i < layout.uPlanes; ++i)
+    {
+        szBytes += static_cast<size_t>(layout.uStrides[i]) * layout.uHeights[i];
+    }
+    return szBytes;
+}
+
+// 合成图像: 斜向移动的渐变叠加伪随机噪声，避免编码器跳过静止宏块
+void Synthesize(const FormatLayout& layout, uint32_t index, uint8_t* data)
+{
+    uint32_t uSeed = 0x9E3779B9u * (index + 1);
+    for (uint32_t p = 0; p < layout.uPlanes; ++p)
+    {
+        for (uint32_t y = 0; y < layout.uHeights[p]; ++y)
+        {
+            for (uint32_t x = 0; x < layout.uStrides[p]; ++x)
+            {
+                uSeed ^= uSeed << 13;
+                uSeed ^= uSeed >> 17;
+                uSeed ^= uSeed << 5;
+                const uint32_t uBase = p == 0 ? (x + y + index * 4) : (128 + ((x + index) >> 3) % 32);
+                *data++ = static_cast<uint8_t>(uBase + (uSeed & 7));
+            }
+        }
+    }
+}
+
+bool LoadFrames(const BenchOptions& options, const FormatLayout& layout, std::vector<std::vector<uint8_t>>& frames)
+{
+    const size_t szFrame = FrameBytes(layout);
+    frames.clear();
+    if (options.strInput.empty())
+    {
+        const size_t szCount = std::min<size_t>(kPreloadFrames, options.uFrames);
+        frames.resize(szCount, std::vector<uint8_t>(szFrame));
+        for (size_t i = 0; i < szCount; ++i)
+        {
+            Synthesize(layout, static_cast<uint32_t>(i), frames[i].data());
+        }
+        return true;
+    }
+    FILE* pFile = fopen(options.strInput.c_str(), "rb");
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+    std::vector<uint8_t> frame(szFrame);
+    while (frames.size() < kPreloadFrames && fread(frame.data(), 1, szFrame, pFile) == szFrame)
+    {
+        frames.push_back(frame);
+    }
+    fclose(pFile);
+    return !frames.empty();
+}
+
+void OnPacket(const NVIVideoEncodedPacket* packet, void* user)
+{
+    BenchContext* pContext = static_cast<BenchContext*>(user);
+    const int64_t nNow = SteadyNanoseconds();
+    const size_t szIndex = static_cast<size_t>(packet->info.tick.value);
+    if (szIndex < pContext->vecTimings.size())
+    {
+        FrameTiming& timing = pContext->vecTimings[szIndex];
+        if (timing.nFirst == 0)
+        {
+            timing.nFirst = nNow;
+        }
+        timing.nLast = nNow;
+    }
+    pContext->uBytes += packet->buffer.size;
+    ++pContext->uPackets;
+}
+
+double Percentile(std::vector<int64_t>& values, double percent)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t szRank = static_cast<size_t>(percent / 100.0 * static_cast<double>(values.size()));
+    szRank = std::min(szRank, values.size() - 1);
+    return static_cast<double>(values[szRank]) / 1e6;
+}
+
+const char* CodecName(uint32_t codec)
+{
+    return codec == NVICodec_HEVC ? "hevc" : "avc";
+}
+
+const char* TuningName(uint32_t tuning)
+{
+    return tuning == X2645Tuning_Throughput ? "throughput" : tuning == X2645Tuning_Parallel ? "parallel" : "latency";
+}
+
+int32_t RunCase(const BenchOptions& options,
+                uint32_t codec,
+                uint32_t width,
+                uint32_t height,
+                const std::string& format,
+                uint16_t sliceMode,
+                uint32_t threads,
+                uint32_t tuning)
+{
+    FormatLayout layout{};
+    if (!MakeLayout(format, width, height, layout))
+    {
+        fprintf(stderr, "unsupported format %s\n", format.c_str());
+        return -1;
+    }
+    std::vector<std::vector<uint8_t>> frames;
+    if (!LoadFrames(options, layout, frames))
+    {
+        fprintf(stderr, "failed to load frames from %s\n", options.strInput.c_str());
+        return -1;
+    }
+    X2645WorkerPoolConfig pool{threads, 0u, -1};
+    SetWorkerPool(&pool);
+    NVIVideoEncode encode = VideoEncodeAlloc(codec);
+    if (encode.encoder == nullptr)
+    {
+        fprintf(stderr, "codec %s is not available\n", CodecName(codec));
+        return -1;
+    }
+    X2645EncodeOptions encodeOptions{};
+    encodeOptions.tuning = tuning;
+    VideoEncodeSetOptions(&encode, &encodeOptions);
+    NVIVideoCodecParam param{};
+    param.codec = codec;
+    param.width = width;
+    param.height = height;
+    param.format = layout.format;
+    param.slice_mode = sliceMode;
+    param.colorspace.primary = NVIPrimary_Unspecified;
+    param.colorspace.transfer = NVITransfer_Unspecified;
+    param.colorspace.matrix = NVIMatrix_Unspecified;
+    param.avg_bitrate = options.uBitrate;
+    param.max_bitrate = options.uBitrate * 3 / 2;
+    param.frame_rate_num = options.uFps;
+    param.frame_rate_den = 1u;
+    param.gop = options.uGop;
+    int32_t nResult = encode.Config(encode.encoder, &param);
+    if (nResult != 0)
+    {
+        fprintf(stderr, "%s %ux%u %s config failed %d\n", CodecName(codec), width, height, format.c_str(), nResult);
+        encode.Release(encode.encoder);
+        return nResult;
+    }
+    X2645PoolUsage usage{};
+    VideoEncodeGetPoolUsage(&encode, &usage);
+
+    BenchContext context;
+    context.vecTimings.assign(options.uFrames, FrameTiming{});
+    NVIVideoImageFrame frame{};
+    frame.buffer.format = layout.format;
+    const int64_t nCpuBegin = ProcessCpuNanoseconds();
+    const int64_t nWallBegin = SteadyNanoseconds();
+    for (uint32_t i = 0; i < options.uFrames; ++i)
+    {
+        uint8_t* pData = frames[i % frames.size()].data();
+        for (uint32_t p = 0; p < layout.uPlanes; ++p)
+        {
+            frame.buffer.planes[p] = pData;
+            frame.buffer.strides[p] = layout.uStrides[p];
+            pData += static_cast<size_t>(layout.uStrides[p]) * layout.uHeights[p];
+        }
+        frame.info.tick.value = static_cast<int64_t>(i);
+        frame.info.frame_kind = i == 0 ? NVIFrameKind_Intra : NVIFrameKind_Delta;
+        context.vecTimings[i].nSubmit = SteadyNanoseconds();
+        if (encode.Encoding(encode.encoder, &frame, &OnPacket, &context) < 0)
+        {
+            break;
+        }
+    }
+    encode.Encoding(encode.encoder, nullptr, &OnPacket, &context);
+    const int64_t nWall = SteadyNanoseconds() - nWallBegin;
+    const int64_t nCpu = ProcessCpuNanoseconds() - nCpuBegin;
+    encode.Release(encode.encoder);
+
+    std::vector<int64_t> vecFrameLatency;
+    std::vector<int64_t> vecFirstLatency;
+    for (const FrameTiming& timing : context.vecTimings)
+    {
+        if (timing.nFirst > 0)
+        {
+            vecFrameLatency.push_back(timing.nLast - timing.nSubmit);
+            vecFirstLatency.push_back(timing.nFirst - timing.nSubmit);
+        }
+    }
+    const size_t szEncoded = vecFrameLatency.size();
+    const double dFrames = static_cast<double>(std::max<size_t>(szEncoded, 1u));
+    printf("{\"codec\":\"%s\",\"width\":%u,\"height\":%u,\"format\":\"%s\",\"slice_mode\":%u,\"tuning\":\"%s\",\"pool_workers\":%u,"
+           "\"threads\":%u,\"source\":\"%s\",\"frames\":%zu,\"packets\":%" PRIu64 ",\"fps\":%.2f,"
+           "\"frame_latency_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"p999\":%.3f},"
+           "\"first_slice_latency_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"p999\":%.3f},"
+           "\"bits_per_frame\":%.0f,\"cpu_ms_per_frame\":%.3f}\n",
+           CodecName(codec), width, height, format.c_str(), sliceMode, TuningName(tuning), usage.workers,
+           usage.threads, options.strInput.empty() ? "synthetic" : "file", szEncoded, context.uPackets,
+           nWall > 0 ? static_cast<double>(szEncoded) * 1e9 / static_cast<double>(nWall) : 0.0, Percentile(vecFrameLatency, 50.0),
+           Percentile(vecFrameLatency, 99.0), Percentile(vecFrameLatency, 99.9), Percentile(vecFirstLatency, 50.0), Percentile(vecFirstLatency, 99.0),
+           Percentile(vecFirstLatency, 99.9), static_cast<double>(context.uBytes) * 8.0 / dFrames, static_cast<double>(nCpu) / 1e6 / dFrames);
+    fflush(stdout);
+    return 0;
+}
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        fprintf(stderr,
+                "usage: x2645_bench [--codec avc,hevc] [--size WxH,...] [--format i420,nv12,nv21,422p,uyvy,yuy2] [--slice 0,1]\n"
+                "                   [--threads N,...] [--tuning latency,throughput,parallel] [--frames N] [--fps N] [--bitrate kbps]\n"
+                "                   [--gop N] [--input file.yuv]\n");
+        return 1;
+    }
+    int nFailed = 0;
+    for (uint32_t codec : options.vecCodecs)
+    {
+        for (const auto& size : options.vecSizes)
+        {
+            for (const std::string& format : options.vecFormats)
+            {
+                for (uint16_t sliceMode : options.vecSliceModes)
+                {
+                    for (uint32_t threads : options.vecThreads)
+                    {
+                        for (uint32_t tuning : options.vecTunings)
+                        {
+                            if (RunCase(options, codec, size.first, size.second, format, sliceMode, threads, tuning) != 0)
+                            {
+                                ++nFailed;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return nFailed == 0 ? 0 : 2;
+}
@@ -0,0 +1,181 @@
+﻿#include "AdmissionControl.h"
+#include <algorithm>
+#include "adaption/Logging.h"
+
+static constexpr int64_t kResyncNs = 1000000000;     // 超时超过1秒视为输入中断或时间戳跳变，重新对齐
+static constexpr int64_t kKeyIntervalNs = 1000000000;  // 只保留关键帧时每秒一个IDR
+static constexpr int64_t kDefaultLatencyFrames = 3;
+static constexpr uint32_t kEscalateScore = 8u;  // 超时一帧加2，按时一帧减1，连续4帧超时升级
+static constexpr uint32_t kCalmFrames = 30u;
+static constexpr uint32_t kMaxCalmFrames = 960u;
+
+void AdmissionControl::Config(const X2645AdmissionConfig* config)
+{
+    m_config = config ? *config : X2645AdmissionConfig{};
+    m_uCalmRequired = kCalmFrames;
+    m_uSinceRecover = kMaxCalmFrames;
+    m_uAdmitted = 0u;
+    m_uDroppedLate = 0u;
+    m_uDroppedRate = 0u;
+    m_uDroppedKey = 0u;
+    m_uOverloads = 0u;
+    m_nSlack = 0;
+}
+
+void AdmissionControl::Reset(uint32_t fpsNum, uint32_t fpsDen)
+{
+    m_nInterval = fpsNum > 0u && fpsDen > 0u ? static_cast<int64_t>(1000000000) * fpsDen / fpsNum : 0;
+    m_nLatency = m_config.latency_ms > 0u ? static_cast<int64_t>(m_config.latency_ms) * 1000000 : m_nInterval * kDefaultLatencyFrames;
+    m_nEncode = 0;
+    m_uInputs = 0u;
+    m_uLate = 0u;
+    m_uCalm = 0u;
+    m_uSinceKey = 0u;
+    m_bSkipNext = false;
+    m_bForcedKey = false;
+    m_uLevel = 0u;
+}
+
+bool AdmissionControl::Admit(int64_t tick, bool requested, int64_t now, bool& key)
+{
+    key = false;
+    m_bForcedKey = false;
+    if (m_nInterval == 0)
+    {
+        ++m_uAdmitted;
+        return true;
+    }
+    if (m_uInputs == 0u)
+    {
+        m_nFirstTick = tick;
+    }
+    int64_t nMedia = static_cast<int64_t>(m_uInputs) * m_nInterval;
+    if (m_config.timescale > 0u)
+    {
+        const int64_t nTicks = tick - m_nFirstTick;
+        const int64_t nScale = m_config.timescale;
+        nMedia = nTicks / nScale * 1000000000 + nTicks % nScale * 1000000000 / nScale;
+    }
+    ++m_uInputs;
+    const int64_t nOffset = now - nMedia;
+    if (m_uInputs == 1u || nOffset < m_nAnchor)
+    {
+        m_nAnchor = nOffset;
+    }
+    int64_t nSlack = nMedia + m_nAnchor + m_nLatency - (now + m_nEncode);
+    if (nSlack < -kResyncNs)
+    {
+        LOG_INFO("X2645 admission resynchronized, frame late {}ms.", -nSlack / 1000000);
+        m_nAnchor = nOffset;
+        nSlack = m_nLatency - m_nEncode;
+    }
+    m_nSlack.store(nSlack, std::memory_order_relaxed);
+    Escalate(nSlack < 0, nSlack);
+    ++m_uSinceKey;
+    if (requested)
+    {
+        m_uSinceKey = 0u;
+        ++m_uAdmitted;
+        return true;
+    }
+    const uint32_t uLevel = m_uLevel.load(std::memory_order_relaxed);
+    if (uLevel >= 2u)
+    {
+        if (static_cast<int64_t>(m_uSinceKey) * m_nInterval < kKeyIntervalNs)
+        {
+            ++m_uDroppedKey;
+            return false;
+        }
+        m_uSinceKey = 0u;
+        m_bForcedKey = true;
+        key = true;
+        ++m_uAdmitted;
+        return true;
+    }
+    if (uLevel == 1u)
+    {
+        const bool bSkip = m_bSkipNext;
+        m_bSkipNext = !m_bSkipNext;
+        if (bSkip)
+        {
+            ++m_uDroppedRate;
+            return false;
+        }
+    }
+    if (nSlack < 0)
+    {
+        ++m_uDroppedLate;
+        return false;
+    }
+    ++m_uAdmitted;
+    return true;
+}
+
+void AdmissionControl::Finish(int64_t nanoseconds)
+{
+    // 强制的IDR耗时远高于普通帧，不计入平均
+    if (m_bForcedKey)
+    {
+        return;
+    }
+    m_nEncode = m_nEncode == 0 ? nanoseconds : m_nEncode + (nanoseconds - m_nEncode) / 8;
+}
+
+void AdmissionControl::Stats(X2645AdmissionStats& stats) const
+{
+    stats.admitted = m_uAdmitted.load(std::memory_order_relaxed);
+    stats.dropped_late = m_uDroppedLate.load(std::memory_order_relaxed);
+    stats.dropped_rate = m_uDroppedRate.load(std::memory_order_relaxed);
+    stats.dropped_key = m_uDroppedKey.load(std::memory_order_relaxed);
+    stats.overloads = m_uOverloads.load(std::memory_order_relaxed);
+    stats.level = m_uLevel.load(std::memory_order_relaxed);
+    stats.slack_ns = m_nSlack.load(std::memory_order_relaxed);
+}
+
+void AdmissionControl::Escalate(bool late, int64_t slack)
+{
+    const uint32_t uLevel = m_uLevel.load(std::memory_order_relaxed);
+    const uint32_t uMaxLevel = m_config.policy - 1u;
+    m_uSinceRecover = std::min(m_uSinceRecover + 1u, kMaxCalmFrames);
+    if (late)
+    {
+        m_uCalm = 0u;
+        m_uLate += 2u;
+        if (m_uLate >= kEscalateScore && uLevel < uMaxLevel)
+        {
+            // 恢复后很快又过载，加倍下次恢复需要的平稳帧数
+            if (m_uSinceRecover < m_uCalmRequired)
+            {
+                m_uCalmRequired = std::min(m_uCalmRequired * 2u, kMaxCalmFrames);
+            }
+            Transit(uLevel + 1u, slack);
+        }
+        return;
+    }
+    m_uLate = m_uLate > 0u ? m_uLate - 1u : 0u;
+    if (uLevel > 0u && ++m_uCalm >= m_uCalmRequired)
+    {
+        m_uSinceRecover = 0u;
+        Transit(uLevel - 1u, slack);
+    }
+    else if (m_uSinceRecover >= kMaxCalmFrames)
+    {
+        m_uCalmRequired = kCalmFrames;  // 长时间稳定后恢复灵敏度
+    }
+}
+
+void AdmissionControl::Transit(uint32_t level, int64_t slack)
+{
+    const uint32_t uPrevious = m_uLevel.load(std::memory_order_relaxed);
+    if (uPrevious == 0u)
+    {
+        ++m_uOverloads;
+    }
+    m_uLevel.store(level, std::memory_order_relaxed);
+    m_uLate = 0u;
+    m_uCalm = 0u;
+    m_uSinceKey = 0u;
+    m_bSkipNext = level == 1u;  // 进入半帧率时立即丢弃下一帧
+    (void)slack;  // 未开启fmt时日志为空
+    LOG_NOTICE("X2645 admission level {} -> {}, slack {}us.", uPrevious, level, slack / 1000);
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "Codec.h"
+
+/*
+ * 准入控制：把输入帧的时间映射到本地时钟得到截止时间，编码前按平均编码耗时预计完成时间。
+ * 连续数帧超时升一级(半帧率、只保留关键帧)，持续有余量后降一级，降级后很快又超时则加倍恢复需要的帧数。
+ * 计数器可在其他线程查询。
+ */
+class AdmissionControl final
+{
+public:
+    void Config(const X2645AdmissionConfig* config);
+    bool Enabled() const { return m_config.policy != X2645Drop_None; }
+    // 编码器重新打开后重新对齐时钟
+    void Reset(uint32_t fpsNum, uint32_t fpsDen);
+    // 返回false时丢弃该帧，requested为调用者请求的关键帧，key返回是否需要强制编码为IDR
+    bool Admit(int64_t tick, bool requested, int64_t now, bool& key);
+    // 记录已编码帧的耗时
+    void Finish(int64_t nanoseconds);
+    void Stats(X2645AdmissionStats& stats) const;
+
+private:
+    void Escalate(bool late, int64_t slack);
+    void Transit(uint32_t level, int64_t slack);
+
+private:
+    X2645AdmissionConfig m_config{};
+    int64_t m_nInterval = 0;  // 帧间隔，为0时不做判断
+    int64_t m_nLatency = 0;
+    int64_t m_nFirstTick = 0;
+    int64_t m_nAnchor = 0;  // 本地时钟与帧时间的差，取最早到达的帧
+    int64_t m_nEncode = 0;  // 编码耗时的指数平均
+    uint64_t m_uInputs = 0u;
+    uint32_t m_uLate = 0u;
+    uint32_t m_uCalm = 0u;
+    uint32_t m_uCalmRequired = 0u;
+    uint32_t m_uSinceRecover = 0u;
+    uint32_t m_uSinceKey = 0u;
+    bool m_bSkipNext = false;
+    bool m_bForcedKey = false;
+    std::atomic<uint32_t> m_uLevel{0u};
+    std::atomic<uint64_t> m_uAdmitted{0u};
+    std::atomic<uint64_t> m_uDroppedLate{0u};
+    std::atomic<uint64_t> m_uDroppedRate{0u};
+    std::atomic<uint64_t> m_uDroppedKey{0u};
+    std::atomic<uint64_t> m_uOverloads{0u};
+    std::atomic<int64_t> m_nSlack{0};
+};
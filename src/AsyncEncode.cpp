@@ -0,0 +1,244 @@
+﻿#include "AsyncEncode.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include "PixelConvert.h"
+#include "adaption/Clock.h"
+#include "adaption/Logging.h"
+#include "adaption/Trace.h"
+
+static std::mutex s_mutex;
+static std::unordered_map<const void*, std::shared_ptr<AsyncEncode>> s_mapAsync;
+
+int32_t AsyncEncode::Start(const NVIVideoEncode& encode, const NVIVideoCodecParam& codec, const X2645AsyncParam& param)
+{
+    if (param.depth == 0u || (param.out == nullptr && param.output_depth == 0u))
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (s_mapAsync.count(encode.encoder) > 0)
+    {
+        return -2;
+    }
+    s_mapAsync[encode.encoder] = std::make_shared<AsyncEncode>(encode, codec, param);
+    return 0;
+}
+
+std::shared_ptr<AsyncEncode> AsyncEncode::Find(const void* encoder)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto it = s_mapAsync.find(encoder);
+    return it != s_mapAsync.end() ? it->second : nullptr;
+}
+
+int32_t AsyncEncode::Stop(const void* encoder)
+{
+    std::shared_ptr<AsyncEncode> pAsync;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto it = s_mapAsync.find(encoder);
+        if (it == s_mapAsync.end())
+        {
+            return -1;
+        }
+        pAsync = std::move(it->second);
+        s_mapAsync.erase(it);
+    }
+    pAsync->Shutdown();
+    return 0;
+}
+
+AsyncEncode::AsyncEncode(const NVIVideoEncode& encode, const NVIVideoCodecParam& codec, const X2645AsyncParam& param)
+    : m_encode(encode)
+    , m_codec(codec)
+    , m_param(param)
+    , m_vecInput(param.depth)
+    , m_vecSubmitted(kSubmitRecords)
+{
+    m_thread = std::thread(&AsyncEncode::Process, this);
+}
+
+AsyncEncode::~AsyncEncode()
+{
+    Shutdown();
+}
+
+void AsyncEncode::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_inputMutex);
+        m_bStop = true;
+    }
+    m_inputCond.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+int32_t AsyncEncode::Submit(const NVIVideoImageFrame* in)
+{
+    // 未知格式的平面数为0，不拷贝就会保留调用者的指针
+    if (in && PlaneCount(static_cast<NVIPixelFormat>(in->buffer.format)) == 0u)
+    {
+        return -3;
+    }
+    std::lock_guard<std::mutex> submit(m_submitMutex);
+    uint32_t uTail = 0u;
+    {
+        std::lock_guard<std::mutex> lock(m_inputMutex);
+        if (m_bStop)
+        {
+            return -1;
+        }
+        if (m_uCount >= m_vecInput.size())
+        {
+            ++m_uRejected;
+            return -2;
+        }
+        uTail = (m_uHead + m_uCount) % static_cast<uint32_t>(m_vecInput.size());
+    }
+    // 队尾的槽位在计数增加之前不会被编码线程访问，拷贝在锁外进行
+    InputSlot& slot = m_vecInput[uTail];
+    slot.submit_time = SteadyNanoseconds();
+    slot.flush = in == nullptr;
+    if (in)
+    {
+        const NVIPixelFormat format = static_cast<NVIPixelFormat>(in->buffer.format);
+        const uint32_t uPlanes = PlaneCount(format);
+        size_t szTotal = 0ull;
+        for (uint32_t i = 0; i < uPlanes; ++i)
+        {
+            szTotal += static_cast<size_t>(in->buffer.strides[i]) * PlaneHeight(format, m_codec.height, i);
+        }
+        TRACE_SCOPE("copy", szTotal);
+        uint8_t* pData = slot.data.Reserve(szTotal);
+        slot.frame = *in;
+        for (uint32_t i = 0; i < uPlanes; ++i)
+        {
+            const size_t szPlane = static_cast<size_t>(in->buffer.strides[i]) * PlaneHeight(format, m_codec.height, i);
+            memcpy(pData, in->buffer.planes[i], szPlane);
+            slot.frame.buffer.planes[i] = pData;
+            pData += szPlane;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_inputMutex);
+        ++m_uCount;
+        ++m_uSubmitted;
+    }
+    m_inputCond.notify_one();
+    return 0;
+}
+
+void AsyncEncode::Process()
+{
+    for (;;)
+    {
+        InputSlot* pSlot = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_inputMutex);
+            while (m_uCount == 0u && !m_bStop)
+            {
+                m_inputCond.wait(lock);
+            }
+            if (m_uCount == 0u)
+            {
+                break;  // 停止前已排队的帧全部编码完成
+            }
+            pSlot = &m_vecInput[m_uHead];
+        }
+        m_nCurrentSubmit = pSlot->submit_time;
+        if (!pSlot->flush)
+        {
+            // 在调用编码器之前写入，编码器线程中的回调只读取
+            m_vecSubmitted[m_uRecorded++ % kSubmitRecords] = {pSlot->frame.info.tick.value, pSlot->submit_time};
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_encodeMutex);
+            m_encode.Encoding(m_encode.encoder, pSlot->flush ? nullptr : &pSlot->frame, &AsyncEncode::OnPacket, this);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_inputMutex);
+            m_uHead = (m_uHead + 1u) % static_cast<uint32_t>(m_vecInput.size());
+            --m_uCount;
+            ++m_uEncoded;
+        }
+    }
+}
+
+void AsyncEncode::OnPacket(const NVIVideoEncodedPacket* packet, void* user)
+{
+    AsyncEncode* pThis = static_cast<AsyncEncode*>(user);
+    if (packet == nullptr || pThis == nullptr)
+    {
+        return;
+    }
+    X2645AsyncPacket output{};
+    output.packet = *packet;
+    output.submit_time = pThis->SubmitTime(packet->info.tick.value);
+    output.output_time = SteadyNanoseconds();
+    if (pThis->m_param.out)
+    {
+        TRACE_SCOPE("output", packet->buffer.size);
+        pThis->m_param.out(&output, pThis->m_param.user);
+        return;
+    }
+    // 多Slice模式下会在x264的slice线程中并发回调
+    std::lock_guard<std::mutex> lock(pThis->m_outputMutex);
+    if (pThis->m_queOutput.size() >= pThis->m_param.output_depth)
+    {
+        pThis->m_queOutput.pop_front();
+        ++pThis->m_uDropped;
+    }
+    pThis->m_queOutput.emplace_back();
+    OutputEntry& entry = pThis->m_queOutput.back();
+    entry.bytes.assign(packet->buffer.bytes, packet->buffer.bytes + packet->buffer.size);
+    entry.packet = output;
+}
+
+int64_t AsyncEncode::SubmitTime(int64_t tick) const
+{
+    // 从最近的帧向前查找，无延迟编码时tick重复也能取到当前帧
+    const uint64_t uCount = std::min<uint64_t>(m_uRecorded, kSubmitRecords);
+    for (uint64_t i = 1; i <= uCount; ++i)
+    {
+        const SubmitRecord& record = m_vecSubmitted[(m_uRecorded - i) % kSubmitRecords];
+        if (record.tick == tick)
+        {
+            return record.submit_time;
+        }
+    }
+    return m_nCurrentSubmit;
+}
+
+int32_t AsyncEncode::Poll(X2645AsyncPacket& packet)
+{
+    std::lock_guard<std::mutex> lock(m_outputMutex);
+    if (m_queOutput.empty())
+    {
+        return 0;
+    }
+    // 取出的数据包由m_polled持有，到下一次Poll之前有效
+    m_polled = std::move(m_queOutput.front());
+    m_queOutput.pop_front();
+    m_polled.packet.packet.buffer.bytes = m_polled.bytes.data();
+    m_polled.packet.packet.buffer.size = m_polled.bytes.size();
+    packet = m_polled.packet;
+    return 1;
+}
+
+void AsyncEncode::Status(X2645AsyncStatus& status)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_inputMutex);
+        status.input_queued = m_uCount;
+        status.submitted = m_uSubmitted;
+        status.rejected = m_uRejected;
+        status.encoded = m_uEncoded;
+    }
+    std::lock_guard<std::mutex> lock(m_outputMutex);
+    status.output_queued = static_cast<uint32_t>(m_queOutput.size());
+    status.dropped = m_uDropped;
+}
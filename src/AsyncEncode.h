@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Codec.h"
+#include "StreamBuffer.h"
+
+/*
+ * 异步编码：`Submit`将输入帧拷贝到有界输入队列后立即返回，
+ * 由插件线程调用编码器，输出的数据包在插件线程回调或放入输出队列由`Poll`取出。
+ */
+class AsyncEncode final
+{
+public:
+    static int32_t Start(const NVIVideoEncode& encode, const NVIVideoCodecParam& codec, const X2645AsyncParam& param);
+    static std::shared_ptr<AsyncEncode> Find(const void* encoder);
+    static int32_t Stop(const void* encoder);
+
+public:
+    AsyncEncode(const NVIVideoEncode& encode, const NVIVideoCodecParam& codec, const X2645AsyncParam& param);
+    ~AsyncEncode();
+
+public:
+    int32_t Submit(const NVIVideoImageFrame* in);
+    int32_t Poll(X2645AsyncPacket& packet);
+    void Status(X2645AsyncStatus& status);
+    // 在两帧之间修改编码器参数时持有，与插件线程的编码互斥
+    std::unique_lock<std::mutex> LockEncoder() { return std::unique_lock<std::mutex>(m_encodeMutex); }
+
+private:
+    static void OnPacket(const NVIVideoEncodedPacket* packet, void* user);
+    int64_t SubmitTime(int64_t tick) const;
+    void Process();
+    void Shutdown();
+
+private:
+    struct InputSlot
+    {
+        NVIVideoImageFrame frame{};
+        StreamBuffer data;
+        int64_t submit_time = 0;
+        bool flush = false;
+    };
+    struct SubmitRecord
+    {
+        int64_t tick = 0;
+        int64_t submit_time = 0;
+    };
+    struct OutputEntry
+    {
+        X2645AsyncPacket packet{};
+        std::vector<uint8_t> bytes;
+    };
+
+    const NVIVideoEncode m_encode;
+    const NVIVideoCodecParam m_codec;
+    const X2645AsyncParam m_param;
+
+    std::mutex m_encodeMutex;
+    std::mutex m_submitMutex;
+    std::mutex m_inputMutex;
+    std::condition_variable m_inputCond;
+    std::vector<InputSlot> m_vecInput;
+    uint32_t m_uHead = 0u;
+    uint32_t m_uCount = 0u;
+    bool m_bStop = false;
+    // 编码器有延迟(lookahead、B帧)时输出的是之前提交的帧，按输出帧的tick在最近编码的帧中找回提交时间
+    static constexpr size_t kSubmitRecords = 256u;
+    std::vector<SubmitRecord> m_vecSubmitted;
+    uint64_t m_uRecorded = 0ull;
+    int64_t m_nCurrentSubmit = 0;
+
+    std::mutex m_outputMutex;
+    std::deque<OutputEntry> m_queOutput;
+    OutputEntry m_polled;
+
+    uint64_t m_uSubmitted = 0ull;
+    uint64_t m_uRejected = 0ull;
+    uint64_t m_uEncoded = 0ull;
+    uint64_t m_uDropped = 0ull;
+
+    std::thread m_thread;
+};
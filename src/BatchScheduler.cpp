@@ -0,0 +1,165 @@
+﻿#include "BatchScheduler.h"
+#include <algorithm>
+#include "AsyncEncode.h"
+#include "WorkerPool.h"
+#include "adaption/Logging.h"
+
+BatchScheduler& BatchScheduler::Instance()
+{
+    static BatchScheduler s_scheduler;
+    return s_scheduler;
+}
+
+BatchScheduler::~BatchScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_cond.notify_all();
+    for (auto& pWorker : m_vecWorkers)
+    {
+        if (pWorker->thread.joinable())
+        {
+            pWorker->thread.join();
+        }
+    }
+}
+
+int32_t BatchScheduler::Run(X2645BatchItem* items, uint32_t count)
+{
+    // 同一实例在一批中出现多次会被并发编码
+    std::vector<const void*> vecEncoders(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const NVIVideoEncode* pEncode = items[i].encode;
+        if (pEncode == nullptr || pEncode->encoder == nullptr || pEncode->Encoding == nullptr || AsyncEncode::Find(pEncode->encoder))
+        {
+            return -1;
+        }
+        vecEncoders[i] = pEncode->encoder;
+    }
+    std::sort(vecEncoders.begin(), vecEncoders.end());
+    if (std::adjacent_find(vecEncoders.begin(), vecEncoders.end()) != vecEncoders.end())
+    {
+        return -1;
+    }
+    Batch batch;
+    batch.remaining = count;
+    if (count == 1u)
+    {
+        Execute({items, &batch});
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_vecWorkers.empty())
+        {
+            Start();
+        }
+        // 在m_mutex内先增加计数，空闲线程检查计数后才等待，不会丢失唤醒
+        m_szQueued += count;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            Worker& worker = *m_vecWorkers[m_szNext];
+            m_szNext = (m_szNext + 1u) % m_vecWorkers.size();
+            std::lock_guard<std::mutex> guard(worker.mutex);
+            worker.tasks.push_back({items + i, &batch});
+        }
+        lock.unlock();
+        m_cond.notify_all();
+        std::unique_lock<std::mutex> wait(batch.mutex);
+        while (batch.remaining > 0u)
+        {
+            batch.cond.wait(wait);
+        }
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (items[i].result < 0)
+        {
+            return -2;
+        }
+    }
+    return 0;
+}
+
+void BatchScheduler::Start()
+{
+    X2645PoolUsage usage{};
+    WorkerPool::Instance().Usage(0u, usage);
+    const uint32_t uWorkers = usage.workers > 0u ? usage.workers : std::max(std::thread::hardware_concurrency(), 1u);
+    // 工作线程继承线程池配置的CPU亲和性
+    WorkerPool::Placement placement;
+    for (uint32_t i = 0; i < uWorkers; ++i)
+    {
+        m_vecWorkers.emplace_back(new Worker());
+    }
+    for (uint32_t i = 0; i < uWorkers; ++i)
+    {
+        m_vecWorkers[i]->thread = std::thread(&BatchScheduler::Process, this, static_cast<size_t>(i));
+    }
+    LOG_NOTICE("X2645 batch scheduler started {} workers.", uWorkers);
+}
+
+void BatchScheduler::Process(size_t index)
+{
+    while (true)
+    {
+        Task task;
+        if (Pop(index, task))
+        {
+            Execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_bStop && m_szQueued == 0u)
+        {
+            m_cond.wait(lock);
+        }
+        if (m_bStop && m_szQueued == 0u)
+        {
+            return;
+        }
+    }
+}
+
+bool BatchScheduler::Pop(size_t index, Task& task)
+{
+    // 先取自己队列的队首，再从其他队列的队尾窃取
+    const size_t szWorkers = m_vecWorkers.size();
+    for (size_t n = 0; n < szWorkers; ++n)
+    {
+        Worker& worker = *m_vecWorkers[(index + n) % szWorkers];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty())
+        {
+            continue;
+        }
+        if (n == 0u)
+        {
+            task = worker.tasks.front();
+            worker.tasks.pop_front();
+        }
+        else
+        {
+            task = worker.tasks.back();
+            worker.tasks.pop_back();
+        }
+        --m_szQueued;
+        return true;
+    }
+    return false;
+}
+
+void BatchScheduler::Execute(const Task& task)
+{
+    X2645BatchItem& item = *task.item;
+    NVIVideoEncode& encode = *item.encode;
+    item.result = encode.Encoding(encode.encoder, item.frame, item.out, item.user);
+    std::lock_guard<std::mutex> lock(task.batch->mutex);
+    if (--task.batch->remaining == 0u)
+    {
+        task.batch->cond.notify_all();
+    }
+}
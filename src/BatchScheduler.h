@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Codec.h"
+
+/*
+ * 多路批量编码调度：每个工作线程有自己的任务队列，提交时按轮转分配，
+ * 线程先按先进先出处理自己的队列，空闲时从其他队列尾部窃取任务。
+ * 每批在所有任务完成后返回，每路每批只编码一帧，各路不会饿死。
+ */
+class BatchScheduler final
+{
+public:
+    static BatchScheduler& Instance();
+
+public:
+    ~BatchScheduler();
+    int32_t Run(X2645BatchItem* items, uint32_t count);
+
+private:
+    struct Batch
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        uint32_t remaining = 0u;
+    };
+    struct Task
+    {
+        X2645BatchItem* item = nullptr;
+        Batch* batch = nullptr;
+    };
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    BatchScheduler() = default;
+    void Start();
+    void Process(size_t index);
+    bool Pop(size_t index, Task& task);
+    static void Execute(const Task& task);
+
+private:
+    std::mutex m_mutex;  // 保护启动停止和空闲等待
+    std::condition_variable m_cond;
+    std::vector<std::unique_ptr<Worker>> m_vecWorkers;
+    std::atomic<size_t> m_szQueued{0u};
+    size_t m_szNext = 0u;
+    bool m_bStop = false;
+};
@@ -1,5 +1,11 @@
 ﻿#include "Codec.h"
+#include "AsyncEncode.h"
+#include "BatchScheduler.h"
+#include "EncodeLadder.h"
+#include "EncoderPool.h"
+#include "WorkerPool.h"
 #include "X264Encoder.hpp"
+#include "adaption/Trace.h"
 
 class X264EncoderDelegate
 {
@@ -23,11 +29,11 @@ public:
         {
             return -1;
         }
+        X264Encoder* pEncoder = static_cast<X264Encoder*>(encoder);
         if (in == nullptr)
         {
-            return 0;
+            return pEncoder->Flush(out, user);
         }
-        X264Encoder* pEncoder = static_cast<X264Encoder*>(encoder);
         return pEncoder->Encoding(*in, out, user);
     }
     static int32_t Release(void* encoder)
@@ -36,6 +42,7 @@ public:
         {
             return 0;
         }
+        AsyncEncode::Stop(encoder);
         X264Encoder* pEncoder = static_cast<X264Encoder*>(encoder);
         delete pEncoder;
         return 0;
@@ -67,11 +74,11 @@ public:
         {
             return -1;
         }
+        X265Encoder* pEncoder = static_cast<X265Encoder*>(encoder);
         if (in == nullptr)
         {
-            return 0;
+            return pEncoder->Flush(out, user);
         }
-        X265Encoder* pEncoder = static_cast<X265Encoder*>(encoder);
         return pEncoder->Encoding(*in, out, user);
     }
     static int32_t Release(void* encoder)
@@ -80,6 +87,7 @@ public:
         {
             return 0;
         }
+        AsyncEncode::Stop(encoder);
         X265Encoder* pEncoder = static_cast<X265Encoder*>(encoder);
         delete pEncoder;
         return 0;
@@ -87,6 +95,60 @@ public:
 };
 #endif
 
+template <typename Visitor>
+static int32_t VisitEncoder(const NVIVideoEncode* encode, Visitor&& visitor)
+{
+    if (encode == nullptr || encode->encoder == nullptr)
+    {
+        return -1;
+    }
+    if (encode->Config == &X264EncoderDelegate::Config)
+    {
+        return visitor(static_cast<X264Encoder*>(encode->encoder));
+    }
+#ifdef ENABLE_X265
+    if (encode->Config == &X265EncoderDelegate::Config)
+    {
+        return visitor(static_cast<X265Encoder*>(encode->encoder));
+    }
+#endif
+    return -1;
+}
+
+// 比较可在线修改的码率控制字段，其他字段变化时返回false
+static bool ReconfigFields(const NVIVideoCodecParam& current, const NVIVideoCodecParam& param, uint32_t& fields)
+{
+    if (current.codec != param.codec || current.width != param.width || current.height != param.height || current.format != param.format ||
+        current.slice_mode != param.slice_mode || current.profile != param.profile || current.gop != param.gop ||
+        current.colorspace.primary != param.colorspace.primary || current.colorspace.transfer != param.colorspace.transfer ||
+        current.colorspace.matrix != param.colorspace.matrix || current.colorspace.range != param.colorspace.range)
+    {
+        return false;
+    }
+    fields = 0u;
+    if (current.avg_bitrate != param.avg_bitrate)
+    {
+        fields |= X2645Reconfig_AvgBitrate;
+    }
+    if (current.max_bitrate != param.max_bitrate)
+    {
+        fields |= X2645Reconfig_MaxBitrate;
+    }
+    if (current.vbv != param.vbv)
+    {
+        fields |= X2645Reconfig_Vbv;
+    }
+    if (current.quality != param.quality)
+    {
+        fields |= X2645Reconfig_Quality;
+    }
+    if (current.frame_rate_num != param.frame_rate_num || current.frame_rate_den != param.frame_rate_den)
+    {
+        fields |= X2645Reconfig_FrameRate;
+    }
+    return true;
+}
+
 NVIVideoEncode VideoEncodeAlloc(uint32_t codec)
 {
     NVIVideoEncode encode{};
@@ -109,7 +171,423 @@ NVIVideoEncode VideoEncodeAlloc(uint32_t codec)
     return encode;
 }
 
+int32_t VideoEncodeSetSegmentOutput(NVIVideoEncode* encode, X2645OnSegments out)
+{
+    std::shared_ptr<AsyncEncode> pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    if (pAsync && out)
+    {
+        return -2;  // 异步模式只支持`OnPacket`输出
+    }
+    std::unique_lock<std::mutex> lock;
+    if (pAsync)
+    {
+        lock = pAsync->LockEncoder();
+    }
+    auto visitor = [out](auto* pEncoder)
+    {
+        pEncoder->SetSegmentOutput(out);
+        return 0;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeSetOptions(NVIVideoEncode* encode, const X2645EncodeOptions* options)
+{
+    if (options == nullptr || options->tuning > X2645Tuning_Parallel || options->slice_layout > X2645SliceLayout_MaxBytes)
+    {
+        return -1;
+    }
+    if ((options->slice_layout != X2645SliceLayout_Auto && options->slice_value == 0u) || options->static_qp > 51u ||
+        options->slice_delivery > X2645SliceDelivery_Ordered)
+    {
+        return -1;
+    }
+    auto visitor = [options](auto* pEncoder)
+    {
+        pEncoder->SetOptions(*options);
+        return 0;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeSetRtpOutput(NVIVideoEncode* encode, const X2645RtpConfig* config)
+{
+    X2645RtpConfig rtp{};
+    if (config && config->out)
+    {
+        rtp = *config;
+        rtp.mtu = rtp.mtu == 0u ? 1200u : rtp.mtu;
+        if (rtp.mtu < 64u)
+        {
+            return -1;
+        }
+    }
+    std::shared_ptr<AsyncEncode> pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    std::unique_lock<std::mutex> lock;
+    if (pAsync)
+    {
+        lock = pAsync->LockEncoder();
+    }
+    auto visitor = [&rtp](auto* pEncoder)
+    {
+        pEncoder->SetRtpOutput(rtp);
+        return 0;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeSetMuxOutput(NVIVideoEncode* encode, const X2645MuxConfig* config)
+{
+    if (config && (config->format > X2645Mux_MPEGTS || (config->format != X2645Mux_None && config->out == nullptr && config->fd < 0)))
+    {
+        return -1;
+    }
+    std::shared_ptr<AsyncEncode> pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    std::unique_lock<std::mutex> lock;
+    if (pAsync)
+    {
+        lock = pAsync->LockEncoder();
+    }
+    auto visitor = [config](auto* pEncoder)
+    {
+        return pEncoder->SetMuxOutput(config);
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeReconfig(NVIVideoEncode* encode, const NVIVideoCodecParam* param, uint32_t* rejected)
+{
+    if (param == nullptr)
+    {
+        return -1;
+    }
+    // 异步模式下在两帧之间修改
+    std::shared_ptr<AsyncEncode> pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    std::unique_lock<std::mutex> lock;
+    if (pAsync)
+    {
+        lock = pAsync->LockEncoder();
+    }
+    auto visitor = [param, rejected](auto* pEncoder)
+    {
+        uint32_t uFields = 0u;
+        if (!ReconfigFields(pEncoder->Param(), *param, uFields))
+        {
+            return -2;
+        }
+        uint32_t uRejected = 0u;
+        const int32_t nResult = pEncoder->Reconfig(*param, uFields, uRejected);
+        if (rejected)
+        {
+            *rejected = uRejected;
+        }
+        return nResult;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeIntraRefresh(NVIVideoEncode* encode)
+{
+    std::shared_ptr<AsyncEncode> pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    std::unique_lock<std::mutex> lock;
+    if (pAsync)
+    {
+        lock = pAsync->LockEncoder();
+    }
+    auto visitor = [](auto* pEncoder)
+    {
+        return pEncoder->IntraRefresh();
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeSetSpeedGovernor(NVIVideoEncode* encode, const X2645SpeedGovernorConfig* config)
+{
+    if (config && (config->min_level >= X2645_SPEED_LEVELS || config->max_level >= X2645_SPEED_LEVELS ||
+                   (config->max_level > 0u && config->min_level > config->max_level) || config->target > 100u))
+    {
+        return -1;
+    }
+    std::shared_ptr<AsyncEncode> pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    std::unique_lock<std::mutex> lock;
+    if (pAsync)
+    {
+        lock = pAsync->LockEncoder();
+    }
+    auto visitor = [config](auto* pEncoder)
+    {
+        return pEncoder->SetSpeedGovernor(config);
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeSetAdmission(NVIVideoEncode* encode, const X2645AdmissionConfig* config)
+{
+    if (config && config->policy > X2645Drop_KeyOnly)
+    {
+        return -1;
+    }
+    std::shared_ptr<AsyncEncode> pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    std::unique_lock<std::mutex> lock;
+    if (pAsync)
+    {
+        lock = pAsync->LockEncoder();
+    }
+    auto visitor = [config](auto* pEncoder)
+    {
+        pEncoder->SetAdmission(config);
+        return 0;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeGetAdmissionStats(NVIVideoEncode* encode, X2645AdmissionStats* stats)
+{
+    if (stats == nullptr)
+    {
+        return -1;
+    }
+    auto visitor = [stats](auto* pEncoder)
+    {
+        pEncoder->GetAdmissionStats(*stats);
+        return 0;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeSetRoi(NVIVideoEncode* encode, const X2645RoiRegion* regions, uint32_t count)
+{
+    if ((regions == nullptr && count > 0u) || count > X2645_MAX_ROI_REGIONS)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (regions[i].qp_offset < -51 || regions[i].qp_offset > 51)
+        {
+            return -1;
+        }
+    }
+    std::shared_ptr<AsyncEncode> pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    std::unique_lock<std::mutex> lock;
+    if (pAsync)
+    {
+        lock = pAsync->LockEncoder();
+    }
+    auto visitor = [regions, count](auto* pEncoder)
+    {
+        return pEncoder->SetRoi(regions, count);
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeGetBufferStats(NVIVideoEncode* encode, X2645BufferStats* stats)
+{
+    if (stats == nullptr)
+    {
+        return -1;
+    }
+    auto visitor = [stats](auto* pEncoder)
+    {
+        pEncoder->GetBufferStats(*stats);
+        return 0;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeGetSliceDeliveryStats(NVIVideoEncode* encode, X2645SliceDeliveryStats* stats)
+{
+    if (stats == nullptr)
+    {
+        return -1;
+    }
+    auto visitor = [stats](auto* pEncoder)
+    {
+        return pEncoder->GetSliceDeliveryStats(*stats) ? 0 : -2;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeGetHeaders(NVIVideoEncode* encode, X2645StreamHeaders* headers)
+{
+    if (headers == nullptr)
+    {
+        return -1;
+    }
+    auto visitor = [headers](auto* pEncoder)
+    {
+        return pEncoder->GetHeaders(*headers) ? 0 : -2;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeGetFrameStats(NVIVideoEncode* encode, X2645FrameStats* stats)
+{
+    if (stats == nullptr)
+    {
+        return -1;
+    }
+    auto visitor = [stats](auto* pEncoder)
+    {
+        return pEncoder->GetFrameStats(*stats) ? 0 : -2;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t SetWorkerPool(const X2645WorkerPoolConfig* config)
+{
+    if (config == nullptr)
+    {
+        return -1;
+    }
+    WorkerPool::Instance().Configure(*config);
+    return 0;
+}
+
+int32_t SetEncoderPool(const X2645EncoderPoolConfig* config)
+{
+    if (config == nullptr)
+    {
+        return -1;
+    }
+    EncoderPool::Instance().Configure(*config);
+    return 0;
+}
+
+int32_t GetEncoderPoolStats(X2645EncoderPoolStats* stats)
+{
+    if (stats == nullptr)
+    {
+        return -1;
+    }
+    EncoderPool::Instance().Stats(*stats);
+    return 0;
+}
+
+int32_t VideoEncodeGetPoolUsage(NVIVideoEncode* encode, X2645PoolUsage* usage)
+{
+    if (usage == nullptr)
+    {
+        return -1;
+    }
+    auto visitor = [usage](auto* pEncoder)
+    {
+        WorkerPool::Instance().Usage(pEncoder->Threads(), *usage);
+        return 0;
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeBatch(X2645BatchItem* items, uint32_t count)
+{
+    if (items == nullptr || count == 0u)
+    {
+        return -1;
+    }
+    return BatchScheduler::Instance().Run(items, count);
+}
+
+int32_t VideoLadderOpen(const NVIVideoCodecParam* input, const X2645LadderParam* param, X2645Ladder** ladder)
+{
+    if (input == nullptr || param == nullptr || ladder == nullptr || param->renditions == nullptr || param->out == nullptr || param->count == 0u ||
+        param->count > X2645_MAX_RENDITIONS)
+    {
+        return -1;
+    }
+    std::unique_ptr<EncodeLadder> pLadder(new EncodeLadder());
+    const int32_t iResult = pLadder->Open(*input, *param);
+    if (iResult != 0)
+    {
+        return iResult;
+    }
+    *ladder = reinterpret_cast<X2645Ladder*>(pLadder.release());
+    return 0;
+}
+
+int32_t VideoLadderEncoding(X2645Ladder* ladder, const NVIVideoImageFrame* in)
+{
+    if (ladder == nullptr)
+    {
+        return -1;
+    }
+    return reinterpret_cast<EncodeLadder*>(ladder)->Encoding(in);
+}
+
+int32_t VideoLadderClose(X2645Ladder* ladder)
+{
+    delete reinterpret_cast<EncodeLadder*>(ladder);
+    return 0;
+}
+
+int32_t VideoEncodeAsyncStart(NVIVideoEncode* encode, const X2645AsyncParam* param)
+{
+    if (param == nullptr)
+    {
+        return -1;
+    }
+    auto visitor = [encode, param](auto* pEncoder)
+    {
+        if (pEncoder->HasSegmentOutput())
+        {
+            return -3;
+        }
+        return AsyncEncode::Start(*encode, pEncoder->Param(), *param);
+    };
+    return VisitEncoder(encode, visitor);
+}
+
+int32_t VideoEncodeSubmit(NVIVideoEncode* encode, const NVIVideoImageFrame* in)
+{
+    auto pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    return pAsync ? pAsync->Submit(in) : -1;
+}
+
+int32_t VideoEncodePoll(NVIVideoEncode* encode, X2645AsyncPacket* packet)
+{
+    auto pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    return pAsync && packet ? pAsync->Poll(*packet) : -1;
+}
+
+int32_t VideoEncodeAsyncStatus(NVIVideoEncode* encode, X2645AsyncStatus* status)
+{
+    auto pAsync = encode ? AsyncEncode::Find(encode->encoder) : nullptr;
+    if (pAsync == nullptr || status == nullptr)
+    {
+        return -1;
+    }
+    pAsync->Status(*status);
+    return 0;
+}
+
+int32_t VideoEncodeAsyncStop(NVIVideoEncode* encode)
+{
+    return encode ? AsyncEncode::Stop(encode->encoder) : -1;
+}
+
 void SetLogging(void (*logging)(int level, const char* message, unsigned int length))
 {
     SetLoggingFunc(logging);
 }
+
+int32_t SetLoggingConfig(const X2645LoggingConfig* config)
+{
+    if (config == nullptr)
+    {
+        return -1;
+    }
+    SetLoggingLevel(config->level);
+    return SetLoggingAsync(config->async != 0u, config->capacity) ? 0 : -2;
+}
+
+int32_t DumpTrace(const char* path)
+{
+    if (path == nullptr)
+    {
+        return -1;
+    }
+#ifdef X2645_TRACE
+    return TraceDump(path);
+#else
+    return -2;
+#endif
+}
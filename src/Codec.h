@@ -2,6 +2,446 @@
 
 #include <NVI/Codec.h>
 
+typedef struct X2645NalSegment
+{
+    const uint8_t* bytes;  // Annex-B NAL（含起始码），由编码器持有
+    size_t size;
+    uint32_t nal_type;
+} X2645NalSegment;
+
+/*
+ * 零拷贝输出：一帧的所有NAL以分段列表的形式一次回调给调用者，
+ * packet->buffer.bytes为空，packet->buffer.size为各分段字节总和，
+ * 分段数据在下一次调用`Encoding`之前有效。
+ * 多Slice模式下的逐Slice输出仍然使用`OnPacket`。
+ */
+typedef void (*X2645OnSegments)(const NVIVideoEncodedPacket* packet, const X2645NalSegment* segments, uint32_t count, void* user);
+
+typedef struct X2645RtpPayload
+{
+    const uint8_t* bytes;  // RTP负载(不含RTP头)，由编码器持有
+    uint32_t size;
+    uint32_t marker;  // 非0时为该帧最后一个负载，对应RTP头的M位
+} X2645RtpPayload;
+
+/*
+ * RTP打包输出：按RFC 6184(H.264)/RFC 7798(H.265)把编码器给出的NAL打包为不超过MTU的负载，
+ * 小NAL合并为STAP-A/AP，大NAL拆分为FU-A/FU，每帧(多Slice模式下每个slice)一次回调。
+ * packet->buffer.bytes为空，packet->buffer.size为负载字节总和，负载数据只在回调期间有效。
+ */
+typedef void (*X2645OnRtpPayloads)(const NVIVideoEncodedPacket* packet, const X2645RtpPayload* payloads, uint32_t count, void* user);
+
+typedef struct X2645RtpConfig
+{
+    uint32_t mtu;  // 单个负载的最大字节数，0表示1200，不能小于64
+    X2645OnRtpPayloads out;
+    void* user;
+} X2645RtpConfig;
+
+typedef struct X2645BufferStats
+{
+    uint64_t capacity;    // 当前实例持有的码流缓存字节数
+    uint64_t high_water;  // 单帧(或单Slice)码流的最大字节数
+    uint64_t pooled;      // 进程级缓存池中空闲的字节数
+} X2645BufferStats;
+
+typedef struct X2645WorkerPoolConfig
+{
+    uint32_t workers;        // 所有编码实例共用的线程总数，0表示使用CPU逻辑核数
+    uint64_t affinity_mask;  // 编码线程的CPU亲和性掩码(前64个逻辑CPU)，0表示不限制
+    int32_t numa_node;       // 编码线程绑定的NUMA节点，-1表示不绑定
+} X2645WorkerPoolConfig;
+
+typedef struct X2645PoolUsage
+{
+    uint32_t threads;  // 当前实例占用的线程数
+    uint32_t used;     // 所有实例占用的线程数
+    uint32_t workers;  // 线程池总数，0表示未配置
+} X2645PoolUsage;
+
+typedef struct X2645AsyncPacket
+{
+    NVIVideoEncodedPacket packet;
+    int64_t submit_time;  // 帧进入输入队列的时间(单调时钟，纳秒)，按`info.tick`对应到输入帧，有编码延迟时tick需唯一
+    int64_t output_time;  // 数据包输出的时间(单调时钟，纳秒)
+} X2645AsyncPacket;
+
+typedef void (*X2645OnAsyncPacket)(const X2645AsyncPacket* packet, void* user);
+
+typedef struct X2645AsyncParam
+{
+    uint32_t depth;         // 输入队列深度，队列满时`VideoEncodeSubmit`返回-2
+    uint32_t output_depth;  // 输出队列深度(`out`为空时有效)，队列满时丢弃最早的数据包
+    X2645OnAsyncPacket out;  // 非空时在插件线程中回调输出，否则由`VideoEncodePoll`取出
+    void* user;
+} X2645AsyncParam;
+
+typedef struct X2645AsyncStatus
+{
+    uint32_t input_queued;
+    uint32_t output_queued;
+    uint64_t submitted;
+    uint64_t rejected;  // 输入队列满被拒绝的帧数
+    uint64_t encoded;
+    uint64_t dropped;  // 输出队列满被丢弃的数据包数
+} X2645AsyncStatus;
+
+typedef enum X2645Tuning
+{
+    X2645Tuning_ZeroLatency = 0,  // 默认，无B帧无lookahead，多线程编码单帧
+    X2645Tuning_Throughput = 1,   // 帧级多线程 + lookahead + B帧，输出有延迟，不支持多Slice模式
+    X2645Tuning_Batch = 2,        // 单线程编码，不占用线程池，用于`VideoEncodeBatch`多路并行；x264不支持多Slice模式
+    X2645Tuning_Parallel = 3,     // 同ZeroLatency无帧延迟，x265按分辨率和核数增加slice和CU级并行分析，用于4K/8K；x264同ZeroLatency
+} X2645Tuning;
+
+/*
+ * 多Slice模式(`NVISliceMode_MultiSlice`)下的slice划分方式，slice数不超过`X2645_MAX_SLICES`和宏块行数。
+ * 按行或按数量划分时每个slice由一个线程编码，线程池不足时slice数随线程数减少。
+ */
+typedef enum X2645SliceLayout
+{
+    X2645SliceLayout_Auto = 0,      // 默认，按272行一个slice
+    X2645SliceLayout_Rows = 1,      // 每个slice最多`slice_value`行宏块(16行像素)，x265按CTU行均分
+    X2645SliceLayout_Count = 2,     // 固定`slice_value`个slice
+    X2645SliceLayout_MaxBytes = 3,  // 仅x264，每个slice最多`slice_value`字节，单线程编码，slice数逐帧变化，只在最后一个slice填写slice_count
+} X2645SliceLayout;
+
+// 多Slice模式下slice数据包的交付方式
+typedef enum X2645SliceDelivery
+{
+    X2645SliceDelivery_Inline = 0,   // 默认，在编码slice的线程中直接回调`OnPacket`，x264 sliced threads下回调来自多个线程且可能乱序
+    X2645SliceDelivery_Ordered = 1,  // 仅x264，slice拷贝到每个slice一个的无锁队列，由编码器的交付线程按slice顺序回调
+} X2645SliceDelivery;
+
+typedef struct X2645EncodeOptions
+{
+    uint32_t tuning;          // X2645Tuning
+    uint32_t frame_stats;     // 非0时统计每帧编码信息，通过`VideoEncodeGetFrameStats`查询
+    uint32_t intra_refresh;   // 非0时用周期帧内刷新代替周期IDR，每gop帧刷新一遍整个画面，只有第一帧是IDR
+    uint32_t slice_layout;    // X2645SliceLayout
+    uint32_t slice_value;     // 与`slice_layout`对应的行数、slice数或字节数，Auto时忽略
+    uint32_t oob_headers;     // 非0时关键帧不再重复输出VPS/SPS/PPS，由`VideoEncodeGetHeaders`带外获取
+    uint32_t roi;             // 非0时开启逐块QP偏移，可通过`VideoEncodeSetRoi`设置感兴趣区域
+    uint32_t static_qp;       // 非0时开启静止区域检测，连续数帧不变的16x16块QP增加该值(1~51)
+    uint32_t slice_delivery;  // X2645SliceDelivery
+} X2645EncodeOptions;
+
+typedef struct X2645StreamHeaders
+{
+    const uint8_t* nals;  // Annex-B格式的VPS(H.265)/SPS/PPS
+    size_t nals_size;
+    const uint8_t* record;  // MP4的avcC(AVCDecoderConfigurationRecord)或hvcC(HEVCDecoderConfigurationRecord)
+    size_t record_size;
+} X2645StreamHeaders;
+
+#define X2645_MAX_SLICES 32
+
+typedef enum X2645FrameType
+{
+    X2645FrameType_Unknown = 0,
+    X2645FrameType_IDR = 1,
+    X2645FrameType_I = 2,
+    X2645FrameType_P = 3,
+    X2645FrameType_B = 4,
+} X2645FrameType;
+
+typedef struct X2645FrameStats
+{
+    int64_t tick;             // 输入帧的tick
+    uint64_t encode_ns;       // 从帧进入`Encoding`到输出的耗时，Throughput模式包含编码器延迟
+    uint64_t first_slice_ns;  // 从帧进入`Encoding`到输出第一个slice的耗时
+    uint64_t cpu_ns;          // 输出该帧的`Encoding`调用所在线程的CPU时间，不含编码器工作线程
+    float avg_qp;
+    float vbv_fullness;   // VBV缓冲占用比例，未启用VBV时为-1
+    uint32_t frame_type;  // X2645FrameType
+    uint32_t slice_count;
+    uint32_t slice_bytes[X2645_MAX_SLICES];
+} X2645FrameStats;
+
 NVI_API NVIVideoEncode VideoEncodeAlloc(uint32_t codec);
 
+/*
+ * 编码选项在下一次`Config`时生效。
+ * Throughput模式下`Encoding`传入空帧表示流结束，排空编码器内所有延迟帧，之后`Encoding`返回-3，需重新`Config`；
+ * 其他模式下空帧不做任何处理。
+ */
+NVI_API int32_t VideoEncodeSetOptions(NVIVideoEncode* encode, const X2645EncodeOptions* options);
+
+typedef enum X2645ReconfigField
+{
+    X2645Reconfig_AvgBitrate = 1 << 0,
+    X2645Reconfig_MaxBitrate = 1 << 1,
+    X2645Reconfig_Vbv = 1 << 2,
+    X2645Reconfig_Quality = 1 << 3,
+    X2645Reconfig_FrameRate = 1 << 4,
+} X2645ReconfigField;
+
+/*
+ * 不重新打开编码器调整码率控制参数，不产生IDR。
+ * param中只允许avg_bitrate、max_bitrate、vbv、quality、frame_rate与当前配置不同，其他字段变化返回-2，需重新`Config`。
+ * rejected返回不能在线修改的字段(X2645ReconfigField)，其余字段已生效：
+ * 帧率不能在线修改；打开时未启用VBV(max_bitrate或vbv为0)则不能在线修改max_bitrate和vbv，max_bitrate不能改为0；
+ * vbv为0时按max_bitrate计算；CRF码率控制(默认)下avg_bitrate不生效。
+ */
+NVI_API int32_t VideoEncodeReconfig(NVIVideoEncode* encode, const NVIVideoCodecParam* param, uint32_t* rejected);
+
+/*
+ * 按需恢复(如收到PLI)：帧内刷新模式下从下一帧开始一轮帧内刷新，不产生IDR；
+ * 未开启帧内刷新时下一帧强制为IDR。返回0表示开始帧内刷新，1表示强制IDR。
+ */
+NVI_API int32_t VideoEncodeIntraRefresh(NVIVideoEncode* encode);
+
+#define X2645_SPEED_LEVELS 5
+#define X2645_SPEED_DEFAULT 1  // `Config`打开编码器时的分析参数，0更快，2~4逐级提高压缩率
+
+typedef void (*X2645OnSpeedLevel)(uint32_t level, uint32_t previous, uint32_t load, void* user);
+
+typedef struct X2645SpeedGovernorConfig
+{
+    uint32_t target;     // 编码耗时占帧间隔的目标百分比，0表示80
+    uint32_t min_level;  // 调节范围，不超过max_level
+    uint32_t max_level;  // 0表示X2645_SPEED_LEVELS - 1
+    X2645OnSpeedLevel report;  // 可为空，级别变化时在编码线程中回调，load为当时的负载百分比
+    void* user;
+} X2645SpeedGovernorConfig;
+
+/*
+ * 按帧率给出的时间预算自动调节运动搜索和模式决策的强度，通过编码器reconfig生效，不产生IDR。
+ * 编码器以subme 0打开且reconfig不能修改，级别只调整运动搜索方式、范围和分区等，亚像素精度保持不变。
+ * `config`为空时关闭并恢复默认级别。每次级别变化都会记录日志并回调`report`。
+ */
+NVI_API int32_t VideoEncodeSetSpeedGovernor(NVIVideoEncode* encode, const X2645SpeedGovernorConfig* config);
+
+// 丢帧策略按顺序逐级加重，策略指定允许达到的最高级别
+typedef enum X2645DropPolicy
+{
+    X2645Drop_None = 0,
+    X2645Drop_Late = 1,      // 丢弃预计无法在截止时间前完成的帧(未编码的输入不会被参考)
+    X2645Drop_HalfRate = 2,  // 持续超时后隔帧丢弃
+    X2645Drop_KeyOnly = 3,   // 半帧率仍超时后每秒只编码一个IDR帧
+} X2645DropPolicy;
+
+typedef struct X2645AdmissionConfig
+{
+    uint32_t policy;      // X2645DropPolicy
+    uint32_t latency_ms;  // 帧时间到编码完成允许的延迟，0表示3个帧间隔
+    uint32_t timescale;   // `info.tick`每秒的计数，0表示忽略tick，按输入帧数和帧率计时
+} X2645AdmissionConfig;
+
+typedef struct X2645AdmissionStats
+{
+    uint64_t admitted;      // 编码的帧数
+    uint64_t dropped_late;  // 预计超时丢弃的帧数
+    uint64_t dropped_rate;  // 半帧率丢弃的帧数
+    uint64_t dropped_key;   // 只保留关键帧时丢弃的帧数
+    uint64_t overloads;     // 进入降帧状态的次数
+    uint32_t level;         // 当前状态：0正常，1半帧率，2只保留关键帧
+    int64_t slack_ns;       // 最近一帧预计完成时间距截止时间的余量，负数表示超时
+} X2645AdmissionStats;
+
+/*
+ * 过载时的准入控制：每帧的截止时间为帧时间(`info.tick`或帧率)加上`latency_ms`，
+ * 以最早到达的帧对齐时钟，按编码耗时的平均值预计完成时间，无法按时完成的帧在编码前丢弃。
+ * 连续超时逐级降到半帧率、只保留关键帧，持续有余量后逐级恢复，请求的关键帧总是编码。
+ * 丢弃的帧`Encoding`返回0且没有输出。`config`为空或`policy`为None时关闭。
+ */
+NVI_API int32_t VideoEncodeSetAdmission(NVIVideoEncode* encode, const X2645AdmissionConfig* config);
+NVI_API int32_t VideoEncodeGetAdmissionStats(NVIVideoEncode* encode, X2645AdmissionStats* stats);
+
+#define X2645_MAX_ROI_REGIONS 16
+
+typedef struct X2645RoiRegion
+{
+    uint32_t x;  // 像素坐标，编码时向外扩展到16x16块边界
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    int32_t qp_offset;  // -51 ~ 51，负数提高画质，正数节省码率；覆盖静止区域检测的偏移
+} X2645RoiRegion;
+
+/*
+ * 设置感兴趣区域，从下一帧开始生效直到再次设置，count为0时清除。
+ * 需要在`Config`之前通过`roi`或`static_qp`选项开启逐块QP偏移，否则返回-2。
+ */
+NVI_API int32_t VideoEncodeSetRoi(NVIVideoEncode* encode, const X2645RoiRegion* regions, uint32_t count);
+
+// 设置后非Slice模式的输出改为零拷贝分段回调，传入nullptr恢复为`OnPacket`输出；异步模式下设置返回-2。
+NVI_API int32_t VideoEncodeSetSegmentOutput(NVIVideoEncode* encode, X2645OnSegments out);
+
+/*
+ * 设置后所有输出改为RTP负载回调(优先于分段输出)，`config`为空或`config->out`为空时恢复。
+ * 多Slice模式下各slice可能在编码线程中并发回调。
+ */
+NVI_API int32_t VideoEncodeSetRtpOutput(NVIVideoEncode* encode, const X2645RtpConfig* config);
+
+/*
+ * 获取参数集，`Config`成功后可用，数据由编码器持有直到`Release`。
+ * 返回-2表示编码器未打开或参数集无法解析。
+ */
+NVI_API int32_t VideoEncodeGetHeaders(NVIVideoEncode* encode, X2645StreamHeaders* headers);
+
+typedef enum X2645MuxFormat
+{
+    X2645Mux_None = 0,
+    X2645Mux_FMP4 = 1,    // 分片MP4(CMAF)：先输出初始化段ftyp+moov，之后每个分片为moof+mdat
+    X2645Mux_MPEGTS = 2,  // MPEG-TS：每段以PAT/PMT开始，每帧一个PES
+} X2645MuxFormat;
+
+typedef enum X2645MuxFlags
+{
+    X2645MuxFlag_Init = 1,     // fMP4初始化段
+    X2645MuxFlag_Segment = 2,  // 新段的第一块数据，从关键帧开始
+} X2645MuxFlags;
+
+// 封装输出，数据只在回调期间有效，一段可能分多次回调
+typedef void (*X2645OnMuxData)(const uint8_t* bytes, size_t size, uint32_t flags, void* user);
+
+typedef struct X2645MuxConfig
+{
+    uint32_t format;       // X2645MuxFormat
+    uint32_t segment_ms;   // 段时长，达到后在下一个关键帧切段，0表示每个关键帧切段
+    uint32_t timescale;    // `info.tick`每秒的计数，0表示忽略tick，按帧率计时
+    uint32_t buffer_size;  // 输出缓存字节数，写满时提前输出(fMP4输出一个CMAF chunk)，0为默认4MB
+    int32_t fd;            // `out`为空时写入的文件描述符
+    X2645OnMuxData out;
+    void* user;
+} X2645MuxConfig;
+
+/*
+ * 封装输出：编码器输出的每一帧NAL直接写入fMP4/MPEG-TS缓存(只拷贝一次)，与`OnPacket`等输出同时进行，
+ * 时间戳取自`info.tick`或帧率，按GOP切段，B帧的重排延迟体现为pts与dts之差。
+ * 在编码线程中输出；冲刷或`Release`时输出剩余数据并结束当前流，下一次`Config`后重新开始。
+ * `config`为空或`format`为None时关闭，返回-2表示参数集无法解析或帧率无效。
+ */
+NVI_API int32_t VideoEncodeSetMuxOutput(NVIVideoEncode* encode, const X2645MuxConfig* config);
+
+NVI_API int32_t VideoEncodeGetBufferStats(NVIVideoEncode* encode, X2645BufferStats* stats);
+
+typedef struct X2645SliceDeliveryStats
+{
+    uint64_t delivered;        // 回调的slice数
+    uint64_t dropped;          // 队列满被丢弃的slice数，丢弃后下一帧强制编码为IDR
+    uint64_t wait_avg_ns;      // slice编码完成到开始回调的平均耗时，包含等待前面slice的时间
+    uint64_t wait_max_ns;
+    uint64_t callback_avg_ns;  // `OnPacket`回调的平均耗时
+    uint64_t callback_max_ns;
+    uint32_t pending;          // 队列中尚未回调的slice数
+} X2645SliceDeliveryStats;
+
+/*
+ * 查询有序交付(`X2645SliceDelivery_Ordered`)的统计，可在任意线程调用。
+ * 有序交付时`OnPacket`在交付线程中回调，`Encoding`返回时当前帧的slice可能尚未回调，`user`需保持有效到`Flush`或`Release`返回；
+ * 编码线程只拷贝数据不等待回调，回调过慢导致队列满时丢弃slice。RTP输出时仍在编码线程中回调。
+ * 返回-2表示未开启有序交付。
+ */
+NVI_API int32_t VideoEncodeGetSliceDeliveryStats(NVIVideoEncode* encode, X2645SliceDeliveryStats* stats);
+
+/*
+ * 查询最近一个输出帧的统计信息，需要在`Config`前设置`X2645EncodeOptions::frame_stats`。
+ * 非Slice模式在`OnPacket`回调中查询得到当前数据包所属帧的统计；多Slice模式下帧的统计在`Encoding`返回后才完整，
+ * slice回调中查询得到的是上一帧。
+ * 返回-2表示未开启统计或还没有输出帧。
+ */
+NVI_API int32_t VideoEncodeGetFrameStats(NVIVideoEncode* encode, X2645FrameStats* stats);
+
+// 配置进程级线程池，只影响之后`Config`的编码实例。
+NVI_API int32_t SetWorkerPool(const X2645WorkerPoolConfig* config);
+
+NVI_API int32_t VideoEncodeGetPoolUsage(NVIVideoEncode* encode, X2645PoolUsage* usage);
+
+typedef void (*X2645OnBatchPacket)(const NVIVideoEncodedPacket* packet, void* user);
+
+typedef struct X2645BatchItem
+{
+    NVIVideoEncode* encode;           // 不能是异步模式的实例，同一批中不能重复
+    const NVIVideoImageFrame* frame;  // 为空时冲刷该路编码器
+    X2645OnBatchPacket out;           // 在调度线程中回调
+    void* user;
+    int32_t result;  // 输出：该路`Encoding`的返回值
+} X2645BatchItem;
+
+/*
+ * 多路批量编码：每路提交一帧，由插件的工作窃取线程池并行编码，全部完成后返回。
+ * 各路应使用`X2645Tuning_Batch`打开，由调度线程提供并行度；同一实例不能同时出现在并发的批量调用中。
+ * 调度线程数为`SetWorkerPool`配置的线程数(未配置时为CPU逻辑核数)，在第一次调用时创建。
+ * 返回0表示全部成功，-2表示有失败的路(见各项result)。
+ */
+NVI_API int32_t VideoEncodeBatch(X2645BatchItem* items, uint32_t count);
+
+#define X2645_MAX_RENDITIONS 8
+
+typedef void (*X2645OnLadderPacket)(const NVIVideoEncodedPacket* packet, uint32_t rendition, void* user);
+
+typedef struct X2645LadderParam
+{
+    const NVIVideoCodecParam* renditions;  // 各路输出参数，宽高为偶数且不大于输入，format被忽略
+    const X2645EncodeOptions* options;     // 可为空，默认各路使用`X2645Tuning_Batch`
+    uint32_t count;                        // 1 ~ X2645_MAX_RENDITIONS
+    X2645OnLadderPacket out;               // 在调度线程中回调，rendition为输出在renditions中的下标
+    void* user;
+} X2645LadderParam;
+
+typedef struct X2645Ladder X2645Ladder;
+
+/*
+ * 同源多码率(simulcast)编码：一帧输入按各路尺寸缩放后并行编码，输入只支持I420/NV12/NV21。
+ * 缩小时逐级2x2减半，每级每帧只计算一次，最后一级使用双线性插值，宽高比不同的输出会有失真。
+ * 各路数据包可能在不同线程并发回调；`VideoLadderEncoding`的in为空时冲刷所有输出，
+ * 返回值同`VideoEncodeBatch`。`VideoLadderOpen`失败时返回-1(参数错误)或-2(编码器打开失败)。
+ */
+NVI_API int32_t VideoLadderOpen(const NVIVideoCodecParam* input, const X2645LadderParam* param, X2645Ladder** ladder);
+NVI_API int32_t VideoLadderEncoding(X2645Ladder* ladder, const NVIVideoImageFrame* in);
+NVI_API int32_t VideoLadderClose(X2645Ladder* ladder);
+
+typedef struct X2645EncoderPoolConfig
+{
+    uint32_t capacity;  // 保留的已打开编码器数量上限，0表示不缓存(默认)
+    uint32_t idle_ms;   // 缓存超过该时间未被复用则关闭，0表示不超时
+} X2645EncoderPoolConfig;
+
+typedef struct X2645EncoderPoolStats
+{
+    uint32_t pooled;   // 当前缓存的编码器数量
+    uint64_t hits;     // `Config`复用缓存的次数
+    uint64_t misses;   // 开启缓存后`Config`新打开编码器的次数
+    uint64_t evicted;  // 因容量或超时关闭的缓存数量
+} X2645EncoderPoolStats;
+
+/*
+ * 编码器缓存：`Release`时把ZeroLatency模式下未冲刷过的编码器句柄留在进程级缓存中，
+ * `Config`的参数和编码选项完全相同时直接复用(保留线程，下一帧强制IDR)，避免重新打开编码器。
+ */
+NVI_API int32_t SetEncoderPool(const X2645EncoderPoolConfig* config);
+NVI_API int32_t GetEncoderPoolStats(X2645EncoderPoolStats* stats);
+
+/*
+ * 异步编码，需在`Config`之后启动，启动后不能再同步调用`Encoding`，
+ * 异步模式使用`OnPacket`输出，不支持零拷贝分段输出，已设置分段输出时启动返回-3。
+ * `VideoEncodeSubmit`拷贝输入帧后立即返回，in为空表示冲刷编码器，像素格式未知时返回-3。
+ * `VideoEncodePoll`返回1表示取出一个数据包，数据在下一次Poll之前有效。
+ * `VideoEncodeAsyncStop`编码完已排队的帧后停止，`Release`时自动停止。
+ */
+NVI_API int32_t VideoEncodeAsyncStart(NVIVideoEncode* encode, const X2645AsyncParam* param);
+NVI_API int32_t VideoEncodeSubmit(NVIVideoEncode* encode, const NVIVideoImageFrame* in);
+NVI_API int32_t VideoEncodePoll(NVIVideoEncode* encode, X2645AsyncPacket* packet);
+NVI_API int32_t VideoEncodeAsyncStatus(NVIVideoEncode* encode, X2645AsyncStatus* status);
+NVI_API int32_t VideoEncodeAsyncStop(NVIVideoEncode* encode);
+
 NVI_API void SetLogging(void (*logging)(int level, const char* message, unsigned int length));
+
+// x264内部的日志级别在下一次`Config`时生效
+typedef struct X2645LoggingConfig
+{
+    int32_t level;      // 输出的最高日志级别(0~7)，级别更高的日志在格式化前丢弃，小于0关闭日志
+    uint32_t async;     // 非0时日志写入无锁环形队列，由后台线程调用日志回调，队列满时丢弃
+    uint32_t capacity;  // 异步队列条数，0为默认值1024，只在第一次开启异步时生效
+} X2645LoggingConfig;
+
+NVI_API int32_t SetLoggingConfig(const X2645LoggingConfig* config);
+
+/*
+ * 输出热路径追踪事件(config、encode、flush、slice回调、copy、output回调)为Chrome trace JSON，
+ * 可用Perfetto或chrome://tracing查看，每个线程保留最近的16384个事件。
+ * 需以`-DX2645_TRACE=ON`编译，否则返回-2；成功返回事件数，文件无法写入返回-1。
+ */
+NVI_API int32_t DumpTrace(const char* path);
@@ -0,0 +1,193 @@
+﻿#include "EncodeLadder.h"
+#include <algorithm>
+#include "BatchScheduler.h"
+#include "adaption/Logging.h"
+
+EncodeLadder::~EncodeLadder()
+{
+    for (Rendition& rendition : m_vecRenditions)
+    {
+        if (rendition.encode.encoder)
+        {
+            rendition.encode.Release(rendition.encode.encoder);
+        }
+    }
+}
+
+int32_t EncodeLadder::Open(const NVIVideoCodecParam& input, const X2645LadderParam& param)
+{
+    if (input.format != NVIPixel_I420 && input.format != NVIPixel_NV12 && input.format != NVIPixel_NV21)
+    {
+        LOG_ERROR("Ladder input format {} is not 8bit 4:2:0.", input.format);
+        return -1;
+    }
+    m_uWidth = input.width;
+    m_uHeight = input.height;
+    m_out = param.out;
+    m_pUser = param.user;
+    // 先确定每个输出尺寸使用的金字塔级别，相同尺寸只保留一张图像
+    uint32_t uDepth = 0u;
+    m_vecRenditions.resize(param.count);
+    for (uint32_t i = 0; i < param.count; ++i)
+    {
+        const NVIVideoCodecParam& rendition = param.renditions[i];
+        if (rendition.width == 0u || rendition.height == 0u || rendition.width > m_uWidth || rendition.height > m_uHeight ||
+            (rendition.width & 1u) != 0u || (rendition.height & 1u) != 0u)
+        {
+            LOG_ERROR("Ladder rendition {} size {}x{} is invalid for input {}x{}.", i, rendition.width, rendition.height, m_uWidth, m_uHeight);
+            return -1;
+        }
+        uint32_t uLevel = 0u;
+        uint32_t uWidth = m_uWidth;
+        uint32_t uHeight = m_uHeight;
+        while ((uWidth + 1) / 2 >= rendition.width && (uHeight + 1) / 2 >= rendition.height)
+        {
+            uWidth = (uWidth + 1) / 2;
+            uHeight = (uHeight + 1) / 2;
+            ++uLevel;
+        }
+        uDepth = std::max(uDepth, uLevel);
+        auto itImage = std::find_if(m_vecImages.begin(), m_vecImages.end(),
+                                    [&rendition](const Image& image) { return image.width == rendition.width && image.height == rendition.height; });
+        if (itImage == m_vecImages.end())
+        {
+            m_vecImages.emplace_back();
+            itImage = m_vecImages.end() - 1;
+            itImage->width = rendition.width;
+            itImage->height = rendition.height;
+            itImage->source = uLevel;
+            // 尺寸正好等于金字塔某一级时直接使用该级，不再分配缓存
+            if (uWidth != rendition.width || uHeight != rendition.height)
+            {
+                Allocate(*itImage);
+            }
+        }
+        m_vecRenditions[i].owner = this;
+        m_vecRenditions[i].index = i;
+        m_vecRenditions[i].image = static_cast<size_t>(itImage - m_vecImages.begin());
+    }
+    m_vecLevels.resize(uDepth);
+    for (uint32_t i = 0; i < uDepth; ++i)
+    {
+        m_vecLevels[i].width = ((i == 0u ? m_uWidth : m_vecLevels[i - 1].width) + 1) / 2;
+        m_vecLevels[i].height = ((i == 0u ? m_uHeight : m_vecLevels[i - 1].height) + 1) / 2;
+        Allocate(m_vecLevels[i]);
+    }
+    // 各输出默认使用Batch模式，由调度线程提供并行度
+    X2645EncodeOptions batch{};
+    batch.tuning = X2645Tuning_Batch;
+    m_vecItems.resize(param.count);
+    for (uint32_t i = 0; i < param.count; ++i)
+    {
+        NVIVideoCodecParam rendition = param.renditions[i];
+        rendition.format = NVIPixel_I420;
+        NVIVideoEncode& encode = m_vecRenditions[i].encode;
+        encode = VideoEncodeAlloc(rendition.codec);
+        if (encode.encoder == nullptr)
+        {
+            LOG_ERROR("Ladder rendition {} codec {} is not supported.", i, rendition.codec);
+            return -1;
+        }
+        if (VideoEncodeSetOptions(&encode, param.options ? &param.options[i] : &batch) != 0)
+        {
+            return -1;
+        }
+        const int32_t iResult = encode.Config(encode.encoder, &rendition);
+        if (iResult != 0)
+        {
+            LOG_ERROR("Ladder rendition {} config failed {}.", i, iResult);
+            return -2;
+        }
+        m_vecItems[i].encode = &encode;
+        m_vecItems[i].out = &EncodeLadder::OnPacket;
+        m_vecItems[i].user = &m_vecRenditions[i];
+    }
+    LOG_INFO("X2645 ladder opened {} renditions, {} pyramid levels, {} scaled images.", param.count, uDepth, m_vecImages.size());
+    return 0;
+}
+
+int32_t EncodeLadder::Encoding(const NVIVideoImageFrame* in)
+{
+    if (in)
+    {
+        m_pInput = m_converter.Convert(*in, m_uWidth, m_uHeight, NVIPixel_I420);
+        if (m_pInput == nullptr)
+        {
+            return -1;
+        }
+        ++m_ullGeneration;
+    }
+    // 缩放在调用线程完成，每级每帧只计算一次，之后各路并行编码
+    for (size_t i = 0; i < m_vecItems.size(); ++i)
+    {
+        m_vecItems[i].frame = in ? &Target(m_vecRenditions[i].image) : nullptr;
+        m_vecItems[i].result = 0;
+    }
+    return BatchScheduler::Instance().Run(m_vecItems.data(), static_cast<uint32_t>(m_vecItems.size()));
+}
+
+void EncodeLadder::Allocate(Image& image)
+{
+    const size_t szLuma = (static_cast<size_t>(image.width) + 63) & ~size_t(63);
+    const size_t szChroma = (static_cast<size_t>((image.width + 1) / 2) + 63) & ~size_t(63);
+    const size_t szChromaHeight = (image.height + 1) / 2;
+    uint8_t* pData = image.buffer.Reserve(szLuma * image.height + szChroma * szChromaHeight * 2);
+    image.frame.buffer.format = NVIPixel_I420;
+    image.frame.buffer.planes[0] = pData;
+    image.frame.buffer.planes[1] = pData + szLuma * image.height;
+    image.frame.buffer.planes[2] = image.frame.buffer.planes[1] + szChroma * szChromaHeight;
+    image.frame.buffer.strides[0] = static_cast<uint32_t>(szLuma);
+    image.frame.buffer.strides[1] = static_cast<uint32_t>(szChroma);
+    image.frame.buffer.strides[2] = static_cast<uint32_t>(szChroma);
+}
+
+const NVIVideoImageFrame& EncodeLadder::Level(uint32_t level)
+{
+    if (level == 0u)
+    {
+        return *m_pInput;
+    }
+    Image& image = m_vecLevels[level - 1];
+    if (image.generation != m_ullGeneration)
+    {
+        const NVIVideoImageFrame& source = Level(level - 1);
+        Scale(source, level - 1, image);
+    }
+    return image.frame;
+}
+
+const NVIVideoImageFrame& EncodeLadder::Target(size_t index)
+{
+    Image& image = m_vecImages[index];
+    const NVIVideoImageFrame& source = Level(image.source);
+    if (image.buffer.Data() == nullptr)
+    {
+        // 与金字塔某一级尺寸相同
+        return source;
+    }
+    if (image.generation != m_ullGeneration)
+    {
+        Scale(source, image.source, image);
+    }
+    return image.frame;
+}
+
+void EncodeLadder::Scale(const NVIVideoImageFrame& source, uint32_t level, Image& image)
+{
+    const uint32_t uWidth = level == 0u ? m_uWidth : m_vecLevels[level - 1].width;
+    const uint32_t uHeight = level == 0u ? m_uHeight : m_vecLevels[level - 1].height;
+    for (uint32_t i = 0; i < 3u; ++i)
+    {
+        const uint32_t uShift = i == 0u ? 0u : 1u;
+        m_scaler.Scale(source.buffer.planes[i], source.buffer.strides[i], (uWidth + uShift) >> uShift, (uHeight + uShift) >> uShift,
+                       image.frame.buffer.planes[i], image.frame.buffer.strides[i], (image.width + uShift) >> uShift, (image.height + uShift) >> uShift);
+    }
+    image.frame.info = m_pInput->info;
+    image.generation = m_ullGeneration;
+}
+
+void EncodeLadder::OnPacket(const NVIVideoEncodedPacket* packet, void* user)
+{
+    const Rendition* pRendition = static_cast<const Rendition*>(user);
+    pRendition->owner->m_out(packet, pRendition->index, pRendition->owner->m_pUser);
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Codec.h"
+#include "PixelConvert.h"
+#include "StreamBuffer.h"
+
+/*
+ * 同源多码率编码：输入帧先统一为I420，再逐级2x2减半生成金字塔，每级每帧最多计算一次；
+ * 各输出尺寸从不小于它的最小一级做最后一次缩放，相同尺寸的不同编码共用一张图像，
+ * 然后通过`BatchScheduler`并行编码所有输出。
+ */
+class EncodeLadder final
+{
+public:
+    ~EncodeLadder();
+    int32_t Open(const NVIVideoCodecParam& input, const X2645LadderParam& param);
+    int32_t Encoding(const NVIVideoImageFrame* in);
+
+private:
+    struct Image
+    {
+        uint32_t width = 0u;
+        uint32_t height = 0u;
+        uint32_t source = 0u;  // 缩放时使用的金字塔级别
+        uint64_t generation = 0ull;
+        StreamBuffer buffer;
+        NVIVideoImageFrame frame{};
+    };
+    struct Rendition
+    {
+        EncodeLadder* owner = nullptr;
+        uint32_t index = 0u;
+        size_t image = 0ull;  // m_vecImages下标
+        NVIVideoEncode encode{};
+    };
+
+    static void Allocate(Image& image);
+    const NVIVideoImageFrame& Level(uint32_t level);
+    const NVIVideoImageFrame& Target(size_t index);
+    void Scale(const NVIVideoImageFrame& source, uint32_t level, Image& image);
+    static void OnPacket(const NVIVideoEncodedPacket* packet, void* user);
+
+private:
+    uint32_t m_uWidth = 0u;
+    uint32_t m_uHeight = 0u;
+    X2645OnLadderPacket m_out = nullptr;
+    void* m_pUser = nullptr;
+    uint64_t m_ullGeneration = 0ull;
+    const NVIVideoImageFrame* m_pInput = nullptr;  // 本帧I420输入，即金字塔第0级
+    PixelConverter m_converter;
+    PlaneScaler m_scaler;
+    std::vector<Image> m_vecLevels;  // 第1级开始的减半图像
+    std::vector<Image> m_vecImages;  // 各输出尺寸的图像
+    std::vector<Rendition> m_vecRenditions;
+    std::vector<X2645BatchItem> m_vecItems;
+};
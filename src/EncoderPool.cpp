@@ -0,0 +1,145 @@
+﻿#include "EncoderPool.h"
+#include <cstring>
+#include "WorkerPool.h"
+#include "adaption/Clock.h"
+#include "adaption/Logging.h"
+
+EncoderPool& EncoderPool::Instance()
+{
+    static EncoderPool s_pool;
+    return s_pool;
+}
+
+EncoderPool::EncoderPool()
+{
+    // 缓存的编码器关闭时归还线程预算，先构造线程池，使其在编码器池之后析构
+    WorkerPool::Instance();
+}
+
+EncoderPool::~EncoderPool()
+{
+    Close(m_lstEntries);
+}
+
+void EncoderPool::Configure(const X2645EncoderPoolConfig& config)
+{
+    std::list<EncoderPoolEntry> expired;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_config = config;
+        CollectExpired(expired, config.capacity);
+    }
+    Close(expired);
+    LOG_NOTICE("X2645 encoder pool: capacity {}, idle {} ms.", config.capacity, config.idle_ms);
+}
+
+bool EncoderPool::Enabled()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_config.capacity > 0u;
+}
+
+bool EncoderPool::Take(uint32_t codec, const NVIVideoCodecParam& param, const X2645EncodeOptions& options, EncoderPoolEntry& entry)
+{
+    std::list<EncoderPoolEntry> expired;
+    bool bHit = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_config.capacity == 0u)
+        {
+            return false;
+        }
+        CollectExpired(expired, m_config.capacity);
+        // 优先复用最近放入的
+        for (auto it = m_lstEntries.rbegin(); it != m_lstEntries.rend(); ++it)
+        {
+            if (SameConfig(*it, codec, param, options))
+            {
+                entry = std::move(*it);
+                m_lstEntries.erase(std::next(it).base());
+                bHit = true;
+                break;
+            }
+        }
+        if (bHit)
+        {
+            ++m_uHits;
+        }
+        else
+        {
+            ++m_uMisses;
+        }
+    }
+    Close(expired);
+    return bHit;
+}
+
+bool EncoderPool::Put(EncoderPoolEntry& entry)
+{
+    std::list<EncoderPoolEntry> expired;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_config.capacity == 0u || entry.handle == nullptr)
+        {
+            return false;
+        }
+        entry.accel = entry.param.accel ? entry.param.accel->type : static_cast<uint32_t>(NVIAccel_Auto);
+        entry.param.accel = nullptr;
+        entry.release_time = SteadyNanoseconds();
+        m_lstEntries.emplace_back(std::move(entry));
+        entry = EncoderPoolEntry{};
+        CollectExpired(expired, m_config.capacity);
+    }
+    Close(expired);
+    return true;
+}
+
+void EncoderPool::Stats(X2645EncoderPoolStats& stats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.pooled = static_cast<uint32_t>(m_lstEntries.size());
+    stats.hits = m_uHits;
+    stats.misses = m_uMisses;
+    stats.evicted = m_uEvicted;
+}
+
+bool EncoderPool::SameConfig(const EncoderPoolEntry& entry, uint32_t codec, const NVIVideoCodecParam& param, const X2645EncodeOptions& options)
+{
+    const NVIVideoCodecParam& key = entry.param;
+    const uint32_t uAccel = param.accel ? param.accel->type : static_cast<uint32_t>(NVIAccel_Auto);
+    return entry.codec == codec && entry.accel == uAccel && key.width == param.width && key.height == param.height && key.format == param.format &&
+           key.slice_mode == param.slice_mode && key.profile == param.profile && key.colorspace.primary == param.colorspace.primary &&
+           key.colorspace.transfer == param.colorspace.transfer && key.colorspace.matrix == param.colorspace.matrix &&
+           key.colorspace.range == param.colorspace.range && key.avg_bitrate == param.avg_bitrate && key.max_bitrate == param.max_bitrate &&
+           key.vbv == param.vbv && key.quality == param.quality && key.frame_rate_num == param.frame_rate_num &&
+           key.frame_rate_den == param.frame_rate_den && key.gop == param.gop && memcmp(&entry.options, &options, sizeof(options)) == 0;
+}
+
+void EncoderPool::CollectExpired(std::list<EncoderPoolEntry>& expired, size_t capacity)
+{
+    if (m_config.idle_ms > 0u)
+    {
+        const int64_t nDeadline = SteadyNanoseconds() - static_cast<int64_t>(m_config.idle_ms) * 1000000;
+        while (!m_lstEntries.empty() && m_lstEntries.front().release_time < nDeadline)
+        {
+            expired.splice(expired.end(), m_lstEntries, m_lstEntries.begin());
+        }
+    }
+    while (m_lstEntries.size() > capacity)
+    {
+        expired.splice(expired.end(), m_lstEntries, m_lstEntries.begin());
+    }
+    m_uEvicted += expired.size();
+}
+
+void EncoderPool::Close(std::list<EncoderPoolEntry>& entries)
+{
+    for (EncoderPoolEntry& entry : entries)
+    {
+        if (entry.close)
+        {
+            entry.close(entry);
+        }
+    }
+    entries.clear();
+}
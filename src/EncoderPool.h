@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include "Codec.h"
+
+// 缓存的编码器句柄，param和options为复用的键
+struct EncoderPoolEntry
+{
+    uint32_t codec = 0u;
+    uint32_t accel = 0u;  // param.accel不保存
+    NVIVideoCodecParam param{};
+    X2645EncodeOptions options{};
+    void* handle = nullptr;
+    const void* api = nullptr;  // x265_api
+    void* context = nullptr;    // x265_param
+    std::string pools;          // x265 numaPools
+    uint32_t threads = 0u;      // 占用的线程池线程数
+    int64_t frame_index = 0;    // 下一帧的pts
+    void (*close)(EncoderPoolEntry& entry) = nullptr;
+    int64_t release_time = 0;
+};
+
+/*
+ * 进程级的已打开编码器缓存，按配置复用编码器句柄，超过容量时关闭最早放入的。
+ */
+class EncoderPool final
+{
+public:
+    static EncoderPool& Instance();
+
+public:
+    void Configure(const X2645EncoderPoolConfig& config);
+    bool Enabled();
+    bool Take(uint32_t codec, const NVIVideoCodecParam& param, const X2645EncodeOptions& options, EncoderPoolEntry& entry);
+    // 缓存已满或未开启时由调用者关闭
+    bool Put(EncoderPoolEntry& entry);
+    void Stats(X2645EncoderPoolStats& stats);
+
+private:
+    EncoderPool();
+    ~EncoderPool();
+    static bool SameConfig(const EncoderPoolEntry& entry, uint32_t codec, const NVIVideoCodecParam& param, const X2645EncodeOptions& options);
+    // 取出需要关闭的缓存，在锁外关闭
+    void CollectExpired(std::list<EncoderPoolEntry>& expired, size_t capacity);
+    static void Close(std::list<EncoderPoolEntry>& entries);
+
+private:
+    std::mutex m_mutex;
+    X2645EncoderPoolConfig m_config{};
+    std::list<EncoderPoolEntry> m_lstEntries;
+    uint64_t m_uHits = 0ull;
+    uint64_t m_uMisses = 0ull;
+    uint64_t m_uEvicted = 0ull;
+};
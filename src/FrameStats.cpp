@@ -0,0 +1,104 @@
+﻿#include "FrameStats.h"
+#include <algorithm>
+#include <iterator>
+#include "adaption/Clock.h"
+
+void FrameStatsRecorder::Config(bool enable, size_t delay, uint32_t vbvKbps, uint32_t vbvKbits, uint32_t fpsNum, uint32_t fpsDen)
+{
+    m_bEnable = enable;
+    m_bValid = false;
+    m_pending = {};
+    m_stats = {};
+    std::fill(std::begin(m_nSliceTime), std::end(m_nSliceTime), 0);
+    m_vecSubmit.assign(enable ? delay + 1u : 0u, 0);
+    m_dVbvSize = 0.0;
+    ConfigVbv(vbvKbps, vbvKbits, fpsNum, fpsDen);
+}
+
+void FrameStatsRecorder::ConfigVbv(uint32_t vbvKbps, uint32_t vbvKbits, uint32_t fpsNum, uint32_t fpsDen)
+{
+    const double dSize = static_cast<double>(vbvKbits) * 1000.0;
+    m_dVbvFill = m_dVbvSize > 0.0 ? std::min(m_dVbvFill, dSize) : dSize;
+    m_dVbvSize = dSize;
+    m_dVbvRate = fpsNum > 0u ? static_cast<double>(vbvKbps) * 1000.0 * fpsDen / fpsNum : 0.0;
+}
+
+void FrameStatsRecorder::Begin()
+{
+    m_nCpuBegin = ThreadCpuNanoseconds();
+}
+
+void FrameStatsRecorder::Submit(size_t index)
+{
+    m_vecSubmit[index % m_vecSubmit.size()] = SteadyNanoseconds();
+}
+
+void FrameStatsRecorder::OnSlice(uint32_t offset, size_t bytes)
+{
+    if (offset < X2645_MAX_SLICES)
+    {
+        m_uSliceBytes[offset] = static_cast<uint32_t>(bytes);
+        m_nSliceTime[offset] = SteadyNanoseconds();
+    }
+}
+
+void FrameStatsRecorder::Finish(size_t index, int64_t tick, uint32_t type, float qp, size_t bytes, double vbvFill)
+{
+    X2645FrameStats& stats = m_pending;
+    const int64_t nSubmit = m_vecSubmit[index % m_vecSubmit.size()];
+    stats.tick = tick;
+    stats.encode_ns = static_cast<uint64_t>(SteadyNanoseconds() - nSubmit);
+    // 编码器返回前已等待所有slice线程，这里读取各slice的记录不需要同步
+    int64_t nFirstSlice = 0;
+    for (uint32_t i = 0; i < X2645_MAX_SLICES; ++i)
+    {
+        if (m_nSliceTime[i] != 0)
+        {
+            nFirstSlice = nFirstSlice == 0 ? m_nSliceTime[i] : std::min(nFirstSlice, m_nSliceTime[i]);
+            stats.slice_bytes[i] = m_uSliceBytes[i];
+            stats.slice_count = i + 1u;
+            m_nSliceTime[i] = 0;
+        }
+    }
+    if (nFirstSlice != 0)
+    {
+        stats.first_slice_ns = static_cast<uint64_t>(nFirstSlice - nSubmit);
+    }
+    stats.cpu_ns = static_cast<uint64_t>(ThreadCpuNanoseconds() - m_nCpuBegin);
+    stats.avg_qp = qp;
+    stats.frame_type = type;
+    if (stats.slice_count == 0u)
+    {
+        stats.first_slice_ns = stats.encode_ns;
+        stats.slice_bytes[0] = static_cast<uint32_t>(bytes);
+        stats.slice_count = 1u;
+    }
+    if (vbvFill >= 0.0)
+    {
+        stats.vbv_fullness = static_cast<float>(vbvFill);
+    }
+    else if (m_dVbvSize > 0.0 && m_dVbvRate > 0.0)
+    {
+        // 漏桶模型：每帧按最大码率注入，按编码后的帧大小取出
+        m_dVbvFill = std::min(m_dVbvFill - static_cast<double>(bytes) * 8.0 + m_dVbvRate, m_dVbvSize);
+        m_dVbvFill = std::max(m_dVbvFill, 0.0);
+        stats.vbv_fullness = static_cast<float>(m_dVbvFill / m_dVbvSize);
+    }
+    else
+    {
+        stats.vbv_fullness = -1.0f;
+    }
+    m_stats = stats;
+    m_pending = {};
+    m_bValid = true;
+}
+
+bool FrameStatsRecorder::Query(X2645FrameStats& stats) const
+{
+    if (!m_bEnable || !m_bValid)
+    {
+        return false;
+    }
+    stats = m_stats;
+    return true;
+}
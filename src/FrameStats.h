@@ -0,0 +1,40 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Codec.h"
+
+/*
+ * 每帧编码统计：`Encoding`入口记录输入时间，编码器输出该帧时汇总，
+ * 输入输出不同序时按编码器回传的序号找回输入时间。
+ */
+class FrameStatsRecorder final
+{
+public:
+    void Config(bool enable, size_t delay, uint32_t vbvKbps, uint32_t vbvKbits, uint32_t fpsNum, uint32_t fpsDen);
+    // 码率调整后更新VBV估算参数，保留当前占用
+    void ConfigVbv(uint32_t vbvKbps, uint32_t vbvKbits, uint32_t fpsNum, uint32_t fpsDen);
+    bool Enabled() const { return m_bEnable; }
+    // 每次调用`Encoding`/`Flush`时开始计算线程CPU时间
+    void Begin();
+    void Submit(size_t index);
+    // 多Slice模式下可在各slice线程中同时调用，每个线程只写自己的slice，汇总在`Finish`中进行
+    void OnSlice(uint32_t offset, size_t bytes);
+    // vbvFill为编码器给出的VBV占用比例，小于0时按漏桶模型估算
+    void Finish(size_t index, int64_t tick, uint32_t type, float qp, size_t bytes, double vbvFill = -1.0);
+    bool Query(X2645FrameStats& stats) const;
+
+private:
+    bool m_bEnable = false;
+    bool m_bValid = false;
+    std::vector<int64_t> m_vecSubmit;
+    int64_t m_nCpuBegin = 0;
+    X2645FrameStats m_pending{};
+    int64_t m_nSliceTime[X2645_MAX_SLICES] = {};  // slice输出时间，0表示该帧没有输出
+    uint32_t m_uSliceBytes[X2645_MAX_SLICES] = {};
+    X2645FrameStats m_stats{};
+    double m_dVbvSize = 0.0;  // bits
+    double m_dVbvRate = 0.0;  // bits per frame
+    double m_dVbvFill = 0.0;
+};
@@ -0,0 +1,265 @@
+﻿#include "ParameterSets.h"
+#include <algorithm>
+
+static constexpr uint8_t kAvcSPS = 7u;
+static constexpr uint8_t kAvcPPS = 8u;
+static constexpr uint8_t kHevcVPS = 32u;
+static constexpr uint8_t kHevcSPS = 33u;
+static constexpr uint8_t kHevcPPS = 34u;
+
+// RBSP比特读取，构造时去掉防竞争字节(00 00 03)
+class BitReader final
+{
+public:
+    BitReader(const uint8_t* data, size_t size)
+    {
+        m_vecData.reserve(size);
+        uint32_t uZeros = 0u;
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (uZeros >= 2u && data[i] == 3u)
+            {
+                uZeros = 0u;
+                continue;
+            }
+            uZeros = data[i] == 0u ? uZeros + 1u : 0u;
+            m_vecData.push_back(data[i]);
+        }
+    }
+
+    uint32_t Read(uint32_t bits)
+    {
+        uint32_t uValue = 0u;
+        for (uint32_t i = 0; i < bits; ++i)
+        {
+            uint32_t uBit = 0u;
+            if ((m_szPos >> 3) < m_vecData.size())
+            {
+                uBit = (m_vecData[m_szPos >> 3] >> (7u - (m_szPos & 7u))) & 1u;
+            }
+            else
+            {
+                m_bOverflow = true;
+            }
+            uValue = (uValue << 1) | uBit;
+            ++m_szPos;
+        }
+        return uValue;
+    }
+
+    void Skip(size_t bits) { m_szPos += bits; }
+
+    uint32_t ReadUE()
+    {
+        uint32_t uZeros = 0u;
+        while (Read(1) == 0u && !m_bOverflow && uZeros < 32u)
+        {
+            ++uZeros;
+        }
+        return uZeros < 32u ? ((1u << uZeros) - 1u + Read(uZeros)) : 0u;
+    }
+
+    bool Valid() const { return !m_bOverflow && (m_szPos >> 3) <= m_vecData.size(); }
+
+private:
+    std::vector<uint8_t> m_vecData;
+    size_t m_szPos = 0ull;
+    bool m_bOverflow = false;
+};
+
+static void PutU16(std::vector<uint8_t>& out, size_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void ParameterSets::Reset(uint32_t codec)
+{
+    m_bHEVC = codec == NVICodec_HEVC;
+    m_bValid = false;
+    m_vecAnnexB.clear();
+    m_vecVPS.clear();
+    m_vecSPS.clear();
+    m_vecPPS.clear();
+    m_vecRecord.clear();
+}
+
+void ParameterSets::Add(const uint8_t* nal, size_t size)
+{
+    size_t szSkip = 0ull;
+    while (szSkip < size && nal[szSkip] == 0u)
+    {
+        ++szSkip;
+    }
+    if (szSkip < size && nal[szSkip] == 1u)
+    {
+        ++szSkip;
+    }
+    if (szSkip + 2u > size)
+    {
+        return;
+    }
+    std::vector<Range>* pList = nullptr;
+    if (m_bHEVC)
+    {
+        const uint8_t uType = static_cast<uint8_t>((nal[szSkip] >> 1) & 0x3Fu);
+        pList = uType == kHevcVPS ? &m_vecVPS : uType == kHevcSPS ? &m_vecSPS : uType == kHevcPPS ? &m_vecPPS : nullptr;
+    }
+    else
+    {
+        const uint8_t uType = static_cast<uint8_t>(nal[szSkip] & 0x1Fu);
+        pList = uType == kAvcSPS ? &m_vecSPS : uType == kAvcPPS ? &m_vecPPS : nullptr;
+    }
+    if (pList)
+    {
+        // 统一使用4字节起始码
+        static const uint8_t kStartCode[4] = {0u, 0u, 0u, 1u};
+        m_vecAnnexB.insert(m_vecAnnexB.end(), kStartCode, kStartCode + 4);
+        pList->push_back({m_vecAnnexB.size(), size - szSkip});
+        m_vecAnnexB.insert(m_vecAnnexB.end(), nal + szSkip, nal + size);
+    }
+}
+
+bool ParameterSets::Build()
+{
+    m_vecRecord.clear();
+    m_bValid = !m_vecSPS.empty() && !m_vecPPS.empty() && (!m_bHEVC || !m_vecVPS.empty());
+    if (m_bValid)
+    {
+        m_bValid = m_bHEVC ? BuildHvcC() : BuildAvcC();
+    }
+    return m_bValid;
+}
+
+bool ParameterSets::Query(X2645StreamHeaders& headers) const
+{
+    if (!m_bValid)
+    {
+        return false;
+    }
+    headers.nals = m_vecAnnexB.data();
+    headers.nals_size = m_vecAnnexB.size();
+    headers.record = m_vecRecord.data();
+    headers.record_size = m_vecRecord.size();
+    return true;
+}
+
+bool ParameterSets::BuildAvcC()
+{
+    // ISO/IEC 14496-15 AVCDecoderConfigurationRecord
+    const uint8_t* pSPS = m_vecAnnexB.data() + m_vecSPS.front().offset;
+    const size_t szSPS = m_vecSPS.front().size;
+    if (szSPS < 4u)
+    {
+        return false;
+    }
+    const uint8_t uProfile = pSPS[1];
+    m_vecRecord.push_back(1u);  // configurationVersion
+    m_vecRecord.push_back(uProfile);
+    m_vecRecord.push_back(pSPS[2]);  // profile_compatibility
+    m_vecRecord.push_back(pSPS[3]);  // AVCLevelIndication
+    m_vecRecord.push_back(0xFFu);    // lengthSizeMinusOne = 3
+    m_vecRecord.push_back(static_cast<uint8_t>(0xE0u | m_vecSPS.size()));
+    AppendArray(0u, m_vecSPS);
+    m_vecRecord.push_back(static_cast<uint8_t>(m_vecPPS.size()));
+    AppendArray(0u, m_vecPPS);
+    if (uProfile == 100u || uProfile == 110u || uProfile == 122u || uProfile == 144u)
+    {
+        BitReader reader(pSPS + 4, szSPS - 4u);
+        reader.ReadUE();  // seq_parameter_set_id
+        const uint32_t uChroma = reader.ReadUE();
+        if (uChroma == 3u)
+        {
+            reader.Skip(1);  // separate_colour_plane_flag
+        }
+        const uint32_t uLumaDepth = reader.ReadUE();
+        const uint32_t uChromaDepth = reader.ReadUE();
+        if (!reader.Valid())
+        {
+            return false;
+        }
+        m_vecRecord.push_back(static_cast<uint8_t>(0xFCu | (uChroma & 0x03u)));
+        m_vecRecord.push_back(static_cast<uint8_t>(0xF8u | (uLumaDepth & 0x07u)));
+        m_vecRecord.push_back(static_cast<uint8_t>(0xF8u | (uChromaDepth & 0x07u)));
+        m_vecRecord.push_back(0u);  // numOfSequenceParameterSetExt
+    }
+    return true;
+}
+
+bool ParameterSets::BuildHvcC()
+{
+    // ISO/IEC 14496-15 HEVCDecoderConfigurationRecord，profile_tier_level从SPS中解析
+    const uint8_t* pSPS = m_vecAnnexB.data() + m_vecSPS.front().offset;
+    BitReader reader(pSPS + 2, m_vecSPS.front().size - 2u);
+    reader.Skip(4);  // sps_video_parameter_set_id
+    const uint32_t uSubLayers = reader.Read(3);
+    const uint32_t uNested = reader.Read(1);
+    uint8_t general[12] = {};  // profile_space ~ general_level_idc
+    for (uint8_t& item : general)
+    {
+        item = static_cast<uint8_t>(reader.Read(8));
+    }
+    uint32_t uSubProfile = 0u;
+    uint32_t uSubLevel = 0u;
+    for (uint32_t i = 0; i < uSubLayers; ++i)
+    {
+        uSubProfile += reader.Read(1);
+        uSubLevel += reader.Read(1);
+    }
+    if (uSubLayers > 0u)
+    {
+        reader.Skip(2u * (8u - uSubLayers));
+    }
+    reader.Skip(88u * uSubProfile + 8u * uSubLevel);
+    reader.ReadUE();  // sps_seq_parameter_set_id
+    const uint32_t uChroma = reader.ReadUE();
+    if (uChroma == 3u)
+    {
+        reader.Skip(1);
+    }
+    reader.ReadUE();  // pic_width_in_luma_samples
+    reader.ReadUE();  // pic_height_in_luma_samples
+    if (reader.Read(1) != 0u)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            reader.ReadUE();  // conf_win_offset
+        }
+    }
+    const uint32_t uLumaDepth = reader.ReadUE();
+    const uint32_t uChromaDepth = reader.ReadUE();
+    if (!reader.Valid())
+    {
+        return false;
+    }
+    m_vecRecord.push_back(1u);  // configurationVersion
+    m_vecRecord.insert(m_vecRecord.end(), general, general + 12);
+    PutU16(m_vecRecord, 0xF000u);  // min_spatial_segmentation_idc未知
+    m_vecRecord.push_back(0xFCu);  // parallelismType未知
+    m_vecRecord.push_back(static_cast<uint8_t>(0xFCu | (uChroma & 0x03u)));
+    m_vecRecord.push_back(static_cast<uint8_t>(0xF8u | (uLumaDepth & 0x07u)));
+    m_vecRecord.push_back(static_cast<uint8_t>(0xF8u | (uChromaDepth & 0x07u)));
+    PutU16(m_vecRecord, 0u);  // avgFrameRate
+    // constantFrameRate = 0, numTemporalLayers, temporalIdNested, lengthSizeMinusOne = 3
+    m_vecRecord.push_back(static_cast<uint8_t>(((uSubLayers + 1u) << 3) | (uNested << 2) | 0x03u));
+    m_vecRecord.push_back(3u);  // numOfArrays
+    AppendArray(kHevcVPS, m_vecVPS);
+    AppendArray(kHevcSPS, m_vecSPS);
+    AppendArray(kHevcPPS, m_vecPPS);
+    return true;
+}
+
+void ParameterSets::AppendArray(uint8_t type, const std::vector<Range>& nals)
+{
+    if (m_bHEVC)
+    {
+        m_vecRecord.push_back(static_cast<uint8_t>(0x80u | type));  // array_completeness = 1
+        PutU16(m_vecRecord, nals.size());
+    }
+    for (const Range& item : nals)
+    {
+        PutU16(m_vecRecord, item.size);
+        m_vecRecord.insert(m_vecRecord.end(), m_vecAnnexB.begin() + static_cast<ptrdiff_t>(item.offset),
+                           m_vecAnnexB.begin() + static_cast<ptrdiff_t>(item.offset + item.size));
+    }
+}
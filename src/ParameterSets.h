@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Codec.h"
+
+/*
+ * 编码器参数集：收集`x264_encoder_headers`/`encoder_headers`输出的VPS/SPS/PPS，
+ * 保存Annex-B格式的原始NAL，并生成MP4使用的avcC/hvcC记录(NAL长度字段为4字节)。
+ */
+class ParameterSets final
+{
+public:
+    void Reset(uint32_t codec);
+    // 加入一个Annex-B NAL(含起始码)，参数集以外的NAL被忽略
+    void Add(const uint8_t* nal, size_t size);
+    // 生成avcC/hvcC，缺少参数集或SPS无法解析时返回false
+    bool Build();
+    bool Query(X2645StreamHeaders& headers) const;
+
+private:
+    struct Range
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    bool BuildAvcC();
+    bool BuildHvcC();
+    void AppendArray(uint8_t type, const std::vector<Range>& nals);
+
+private:
+    bool m_bHEVC = false;
+    bool m_bValid = false;
+    std::vector<uint8_t> m_vecAnnexB;
+    std::vector<Range> m_vecVPS;  // 不含起始码的NAL在m_vecAnnexB中的位置
+    std::vector<Range> m_vecSPS;
+    std::vector<Range> m_vecPPS;
+    std::vector<uint8_t> m_vecRecord;
+};
@@ -0,0 +1,664 @@
+﻿#include "PixelConvert.h"
+#include <cstring>
+#include "adaption/Logging.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define X2645_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define X2645_TARGET(isa)
+#else
+#define X2645_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define X2645_NEON 1
+#include <arm_neon.h>
+#endif
+
+struct PixelKernels
+{
+    const char* name;
+    // NV12/NV21色度平面拆分为两个平面，pairs为色度采样对数
+    void (*SplitUV)(const uint8_t* src, uint8_t* u, uint8_t* v, size_t pairs);
+    // 16bit采样字节序翻转
+    void (*Swap16)(const uint8_t* src, uint8_t* dst, size_t samples);
+    // UYVY/YUY2拆分为I422，pairs为水平像素对数
+    void (*SplitUYVY)(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, size_t pairs);
+    void (*SplitYUY2)(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, size_t pairs);
+    // 8bit平面2x2均值缩小一行，a/b为相邻的两行源数据，pairs为输出像素数
+    void (*HalveRow)(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t pairs);
+    // 两行按weight/256线性混合，weight取值0~256
+    void (*BlendRows)(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t samples, uint32_t weight);
+    // 每16字节一组累加两行的绝对差之和，sums[i]对应第i组
+    void (*SadBlocks)(const uint8_t* a, const uint8_t* b, uint32_t* sums, size_t blocks);
+};
+
+//////////////////////////////////////////////////////////////////////////
+// C实现，同时用于SIMD实现的尾部处理
+static void SplitUV_C(const uint8_t* src, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    for (size_t i = 0; i < pairs; ++i)
+    {
+        u[i] = src[2 * i];
+        v[i] = src[2 * i + 1];
+    }
+}
+
+static void Swap16_C(const uint8_t* src, uint8_t* dst, size_t samples)
+{
+    for (size_t i = 0; i < samples; ++i)
+    {
+        const uint8_t uHigh = src[2 * i];
+        dst[2 * i] = src[2 * i + 1];
+        dst[2 * i + 1] = uHigh;
+    }
+}
+
+static void SplitUYVY_C(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    for (size_t i = 0; i < pairs; ++i)
+    {
+        u[i] = src[4 * i];
+        y[2 * i] = src[4 * i + 1];
+        v[i] = src[4 * i + 2];
+        y[2 * i + 1] = src[4 * i + 3];
+    }
+}
+
+static void SplitYUY2_C(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    for (size_t i = 0; i < pairs; ++i)
+    {
+        y[2 * i] = src[4 * i];
+        u[i] = src[4 * i + 1];
+        y[2 * i + 1] = src[4 * i + 2];
+        v[i] = src[4 * i + 3];
+    }
+}
+
+static void HalveRow_C(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t pairs)
+{
+    for (size_t i = 0; i < pairs; ++i)
+    {
+        dst[i] = static_cast<uint8_t>((a[2 * i] + a[2 * i + 1] + b[2 * i] + b[2 * i + 1] + 2) >> 2);
+    }
+}
+
+static void BlendRows_C(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t samples, uint32_t weight)
+{
+    for (size_t i = 0; i < samples; ++i)
+    {
+        dst[i] = static_cast<uint8_t>((a[i] * (256u - weight) + b[i] * weight + 128u) >> 8);
+    }
+}
+
+static uint32_t Sad_C(const uint8_t* a, const uint8_t* b, size_t samples)
+{
+    uint32_t uSum = 0u;
+    for (size_t i = 0; i < samples; ++i)
+    {
+        uSum += static_cast<uint32_t>(a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]);
+    }
+    return uSum;
+}
+
+static void SadBlocks_C(const uint8_t* a, const uint8_t* b, uint32_t* sums, size_t blocks)
+{
+    for (size_t i = 0; i < blocks; ++i)
+    {
+        sums[i] += Sad_C(a + 16 * i, b + 16 * i, 16);
+    }
+}
+
+#ifdef X2645_X86
+X2645_TARGET("sse4.1")
+static void SplitUV_SSE4(const uint8_t* src, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    const __m128i kShuffle = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16)
+    {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i)), kShuffle);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 16)), kShuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u + i), _mm_unpacklo_epi64(a, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v + i), _mm_unpackhi_epi64(a, b));
+    }
+    SplitUV_C(src + 2 * i, u + i, v + i, pairs - i);
+}
+
+X2645_TARGET("sse4.1")
+static void Swap16_SSE4(const uint8_t* src, uint8_t* dst, size_t samples)
+{
+    const __m128i kShuffle = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_shuffle_epi8(a, kShuffle));
+    }
+    Swap16_C(src + 2 * i, dst + 2 * i, samples - i);
+}
+
+// 16字节(8像素)打包数据经kShuffle重排为[Y0..Y7, U0..U3, V0..V3]
+X2645_TARGET("sse4.1")
+static inline void SplitPacked_SSE4(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, size_t pairs, __m128i kShuffle)
+{
+    const __m128i kChroma = _mm_setr_epi8(0, 1, 2, 3, 8, 9, 10, 11, 4, 5, 6, 7, 12, 13, 14, 15);
+    for (size_t i = 0; i < pairs; i += 8)
+    {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i)), kShuffle);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i + 16)), kShuffle);
+        __m128i uv = _mm_shuffle_epi8(_mm_unpackhi_epi64(a, b), kChroma);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + 2 * i), _mm_unpacklo_epi64(a, b));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + i), uv);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + i), _mm_srli_si128(uv, 8));
+    }
+}
+
+X2645_TARGET("sse4.1")
+static void SplitUYVY_SSE4(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    const size_t szBlock = pairs & ~size_t(7);
+    SplitPacked_SSE4(src, y, u, v, szBlock, _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, 0, 4, 8, 12, 2, 6, 10, 14));
+    SplitUYVY_C(src + 4 * szBlock, y + 2 * szBlock, u + szBlock, v + szBlock, pairs - szBlock);
+}
+
+X2645_TARGET("sse4.1")
+static void SplitYUY2_SSE4(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    const size_t szBlock = pairs & ~size_t(7);
+    SplitPacked_SSE4(src, y, u, v, szBlock, _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 5, 9, 13, 3, 7, 11, 15));
+    SplitYUY2_C(src + 4 * szBlock, y + 2 * szBlock, u + szBlock, v + szBlock, pairs - szBlock);
+}
+
+// maddubs把水平相邻两像素求和到16bit，再垂直相加，结果与C实现一致
+X2645_TARGET("sse4.1")
+static inline __m128i SumQuad_SSE4(const uint8_t* a, const uint8_t* b, __m128i kOnes)
+{
+    const __m128i va = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)), kOnes);
+    const __m128i vb = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)), kOnes);
+    return _mm_add_epi16(va, vb);
+}
+
+X2645_TARGET("sse4.1")
+static void HalveRow_SSE4(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t pairs)
+{
+    const __m128i kOnes = _mm_set1_epi8(1);
+    const __m128i kRound = _mm_set1_epi16(2);
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16)
+    {
+        const __m128i lo = _mm_srli_epi16(_mm_add_epi16(SumQuad_SSE4(a + 2 * i, b + 2 * i, kOnes), kRound), 2);
+        const __m128i hi = _mm_srli_epi16(_mm_add_epi16(SumQuad_SSE4(a + 2 * i + 16, b + 2 * i + 16, kOnes), kRound), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    HalveRow_C(a + 2 * i, b + 2 * i, dst + i, pairs - i);
+}
+
+X2645_TARGET("sse4.1")
+static void BlendRows_SSE4(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t samples, uint32_t weight)
+{
+    // a * (256 - w) + b * w 不超过65280，16bit无符号乘加不会溢出
+    const __m128i kWeightA = _mm_set1_epi16(static_cast<short>(256u - weight));
+    const __m128i kWeightB = _mm_set1_epi16(static_cast<short>(weight));
+    const __m128i kRound = _mm_set1_epi16(128);
+    const __m128i kZero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16)
+    {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, kZero), kWeightA), _mm_mullo_epi16(_mm_unpacklo_epi8(vb, kZero), kWeightB));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, kZero), kWeightA), _mm_mullo_epi16(_mm_unpackhi_epi8(vb, kZero), kWeightB));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, kRound), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, kRound), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    BlendRows_C(a + i, b + i, dst + i, samples - i, weight);
+}
+
+X2645_TARGET("sse4.1")
+static void SadBlocks_SSE4(const uint8_t* a, const uint8_t* b, uint32_t* sums, size_t blocks)
+{
+    for (size_t i = 0; i < blocks; ++i)
+    {
+        const __m128i sad = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 16 * i)),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16 * i)));
+        sums[i] += static_cast<uint32_t>(_mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4));
+    }
+}
+
+X2645_TARGET("avx2")
+static void SplitUV_AVX2(const uint8_t* src, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    const __m256i kShuffle = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15, 0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    size_t i = 0;
+    for (; i + 32 <= pairs; i += 32)
+    {
+        // 每个128bit通道内分离为[U x8, V x8]，再跨通道合并
+        __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i)), kShuffle);
+        __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i + 32)), kShuffle);
+        a = _mm256_permute4x64_epi64(a, 0xD8);
+        b = _mm256_permute4x64_epi64(b, 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(u + i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + i), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    SplitUV_SSE4(src + 2 * i, u + i, v + i, pairs - i);
+}
+
+X2645_TARGET("avx2")
+static void Swap16_AVX2(const uint8_t* src, uint8_t* dst, size_t samples)
+{
+    const __m256i kShuffle = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i), _mm256_shuffle_epi8(a, kShuffle));
+    }
+    Swap16_SSE4(src + 2 * i, dst + 2 * i, samples - i);
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+static bool CpuSupports(int leaf, int reg, int bit)
+{
+    int regs[4] = {};
+    __cpuidex(regs, leaf, 0);
+    return (regs[reg] & (1 << bit)) != 0;
+}
+#endif
+
+static bool HasSSE41()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return CpuSupports(1, 2, 19);
+#else
+    return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+static bool HasAVX2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    // 同时需要操作系统保存YMM状态(OSXSAVE + XCR0)
+    return CpuSupports(7, 1, 5) && CpuSupports(1, 2, 27) && (_xgetbv(0) & 0x6) == 0x6;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef X2645_NEON
+static void SplitUV_NEON(const uint8_t* src, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16)
+    {
+        uint8x16x2_t uv = vld2q_u8(src + 2 * i);
+        vst1q_u8(u + i, uv.val[0]);
+        vst1q_u8(v + i, uv.val[1]);
+    }
+    SplitUV_C(src + 2 * i, u + i, v + i, pairs - i);
+}
+
+static void Swap16_NEON(const uint8_t* src, uint8_t* dst, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8)
+    {
+        vst1q_u8(dst + 2 * i, vrev16q_u8(vld1q_u8(src + 2 * i)));
+    }
+    Swap16_C(src + 2 * i, dst + 2 * i, samples - i);
+}
+
+static void SplitUYVY_NEON(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16)
+    {
+        uint8x16x4_t uyvy = vld4q_u8(src + 4 * i);
+        uint8x16x2_t luma = {{uyvy.val[1], uyvy.val[3]}};
+        vst2q_u8(y + 2 * i, luma);
+        vst1q_u8(u + i, uyvy.val[0]);
+        vst1q_u8(v + i, uyvy.val[2]);
+    }
+    SplitUYVY_C(src + 4 * i, y + 2 * i, u + i, v + i, pairs - i);
+}
+
+static void SplitYUY2_NEON(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, size_t pairs)
+{
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16)
+    {
+        uint8x16x4_t yuy2 = vld4q_u8(src + 4 * i);
+        uint8x16x2_t luma = {{yuy2.val[0], yuy2.val[2]}};
+        vst2q_u8(y + 2 * i, luma);
+        vst1q_u8(u + i, yuy2.val[1]);
+        vst1q_u8(v + i, yuy2.val[3]);
+    }
+    SplitYUY2_C(src + 4 * i, y + 2 * i, u + i, v + i, pairs - i);
+}
+
+static void HalveRow_NEON(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t pairs)
+{
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16)
+    {
+        // 水平相邻两像素求和后再垂直相加，结果与C实现一致
+        uint16x8_t lo = vaddq_u16(vpaddlq_u8(vld1q_u8(a + 2 * i)), vpaddlq_u8(vld1q_u8(b + 2 * i)));
+        uint16x8_t hi = vaddq_u16(vpaddlq_u8(vld1q_u8(a + 2 * i + 16)), vpaddlq_u8(vld1q_u8(b + 2 * i + 16)));
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+    }
+    HalveRow_C(a + 2 * i, b + 2 * i, dst + i, pairs - i);
+}
+
+static void BlendRows_NEON(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t samples, uint32_t weight)
+{
+    const uint8x8_t kWeightA = vdup_n_u8(static_cast<uint8_t>(256u - weight));
+    const uint8x8_t kWeightB = vdup_n_u8(static_cast<uint8_t>(weight));
+    size_t i = 0;
+    // weight为0时256无法放入8bit，交给C实现
+    for (; weight > 0u && i + 16 <= samples; i += 16)
+    {
+        const uint8x16_t va = vld1q_u8(a + i);
+        const uint8x16_t vb = vld1q_u8(b + i);
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(va), kWeightA), vget_low_u8(vb), kWeightB);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(va), kWeightA), vget_high_u8(vb), kWeightB);
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+    }
+    BlendRows_C(a + i, b + i, dst + i, samples - i, weight);
+}
+
+static void SadBlocks_NEON(const uint8_t* a, const uint8_t* b, uint32_t* sums, size_t blocks)
+{
+    for (size_t i = 0; i < blocks; ++i)
+    {
+        sums[i] += vaddlvq_u8(vabdq_u8(vld1q_u8(a + 16 * i), vld1q_u8(b + 16 * i)));
+    }
+}
+#endif
+
+static PixelKernels SelectKernels()
+{
+    PixelKernels kernels{"c", &SplitUV_C, &Swap16_C, &SplitUYVY_C, &SplitYUY2_C, &HalveRow_C, &BlendRows_C, &SadBlocks_C};
+#ifdef X2645_X86
+    if (HasSSE41())
+    {
+        kernels = {"sse4.1", &SplitUV_SSE4, &Swap16_SSE4, &SplitUYVY_SSE4, &SplitYUY2_SSE4, &HalveRow_SSE4, &BlendRows_SSE4, &SadBlocks_SSE4};
+        if (HasAVX2())
+        {
+            kernels.name = "avx2";
+            kernels.SplitUV = &SplitUV_AVX2;
+            kernels.Swap16 = &Swap16_AVX2;
+        }
+    }
+#elif defined(X2645_NEON)
+    kernels = {"neon", &SplitUV_NEON, &Swap16_NEON, &SplitUYVY_NEON, &SplitYUY2_NEON, &HalveRow_NEON, &BlendRows_NEON, &SadBlocks_NEON};
+#endif
+    return kernels;
+}
+
+static const PixelKernels& Kernels()
+{
+    static const PixelKernels s_kernels = SelectKernels();
+    return s_kernels;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// V210: 每16字节(4个小端32bit字)存放6个像素的10bit 4:2:2采样
+template <typename Sample, int kShift>
+static void V210ToPlanar(const uint8_t* src, Sample* y, Sample* u, Sample* v, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; x += 6, src += 16)
+    {
+        uint32_t w[4];
+        memcpy(w, src, sizeof(w));
+        const Sample luma[6] = {Sample(((w[0] >> 10) & 0x3FF) >> kShift), Sample((w[1] & 0x3FF) >> kShift),         Sample(((w[1] >> 20) & 0x3FF) >> kShift),
+                                Sample(((w[2] >> 10) & 0x3FF) >> kShift), Sample((w[3] & 0x3FF) >> kShift),         Sample(((w[3] >> 20) & 0x3FF) >> kShift)};
+        const Sample cb[3] = {Sample((w[0] & 0x3FF) >> kShift), Sample(((w[1] >> 10) & 0x3FF) >> kShift), Sample(((w[2] >> 20) & 0x3FF) >> kShift)};
+        const Sample cr[3] = {Sample(((w[0] >> 20) & 0x3FF) >> kShift), Sample((w[2] & 0x3FF) >> kShift), Sample(((w[3] >> 10) & 0x3FF) >> kShift)};
+        const uint32_t uCount = width - x < 6u ? width - x : 6u;
+        for (uint32_t i = 0; i < uCount; ++i)
+        {
+            y[x + i] = luma[i];
+        }
+        for (uint32_t i = 0; i < (uCount + 1) / 2; ++i)
+        {
+            u[x / 2 + i] = cb[i];
+            v[x / 2 + i] = cr[i];
+        }
+    }
+}
+
+bool IsPlanarFormat(NVIPixelFormat format)
+{
+    switch (format)
+    {
+    case NVIPixel_I420:
+    case NVIPixel_422P:
+    case NVIPixel_420P10LE:
+    case NVIPixel_420P10BE:
+    case NVIPixel_422P10LE:
+    case NVIPixel_422P10BE: return true;
+    default: return false;
+    }
+}
+
+uint32_t PlaneCount(NVIPixelFormat format)
+{
+    switch (format)
+    {
+    case NVIPixel_NV12:
+    case NVIPixel_NV21: return 2u;
+    case NVIPixel_V210:
+    case NVIPixel_UYVY:
+    case NVIPixel_YUY2: return 1u;
+    default: return IsPlanarFormat(format) ? 3u : 0u;
+    }
+}
+
+uint32_t PlaneHeight(NVIPixelFormat format, uint32_t height, uint32_t plane)
+{
+    if (plane == 0u)
+    {
+        return height;
+    }
+    switch (format)
+    {
+    case NVIPixel_I420:
+    case NVIPixel_NV12:
+    case NVIPixel_NV21:
+    case NVIPixel_420P10LE:
+    case NVIPixel_420P10BE: return (height + 1) / 2;
+    default: return height;
+    }
+}
+
+const char* PixelConverter::KernelName()
+{
+    return Kernels().name;
+}
+
+uint8_t* PixelConverter::Planes(NVIPixelFormat format, uint32_t width, uint32_t height)
+{
+    const bool bWide = format == NVIPixel_420P10LE || format == NVIPixel_422P10LE;
+    const bool b420 = format == NVIPixel_I420 || format == NVIPixel_420P10LE;
+    const size_t szLuma = ((static_cast<size_t>(width) << (bWide ? 1 : 0)) + 63) & ~size_t(63);
+    const size_t szChroma = ((static_cast<size_t>((width + 1) / 2) << (bWide ? 1 : 0)) + 63) & ~size_t(63);
+    const size_t szChromaHeight = b420 ? (height + 1) / 2 : height;
+    uint8_t* pData = m_scratch.Reserve(szLuma * height + szChroma * szChromaHeight * 2);
+    m_pPlanes[0] = pData;
+    m_pPlanes[1] = pData + szLuma * height;
+    m_pPlanes[2] = m_pPlanes[1] + szChroma * szChromaHeight;
+    m_szStrides[0] = szLuma;
+    m_szStrides[1] = szChroma;
+    m_szStrides[2] = szChroma;
+    m_frame.buffer.format = format;
+    for (uint32_t i = 0; i < 3u; ++i)
+    {
+        m_frame.buffer.planes[i] = m_pPlanes[i];
+        m_frame.buffer.strides[i] = static_cast<uint32_t>(m_szStrides[i]);
+    }
+    return pData;
+}
+
+const NVIVideoImageFrame* PixelConverter::Convert(const NVIVideoImageFrame& in, uint32_t width, uint32_t height, NVIPixelFormat target)
+{
+    const NVIPixelFormat format = static_cast<NVIPixelFormat>(in.buffer.format);
+    if (format == target)
+    {
+        return &in;
+    }
+    const PixelKernels& kernels = Kernels();
+    const uint8_t* const* pSrc = in.buffer.planes;
+    const auto* pStride = in.buffer.strides;
+    m_frame.info = in.info;
+    if ((format == NVIPixel_NV12 || format == NVIPixel_NV21) && target == NVIPixel_I420)
+    {
+        Planes(target, width, height);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            memcpy(m_pPlanes[0] + m_szStrides[0] * y, pSrc[0] + pStride[0] * y, width);
+        }
+        const uint32_t uPlane = format == NVIPixel_NV12 ? 1u : 2u;
+        for (uint32_t y = 0; y < (height + 1) / 2; ++y)
+        {
+            kernels.SplitUV(pSrc[1] + pStride[1] * y, m_pPlanes[uPlane] + m_szStrides[1] * y, m_pPlanes[3u - uPlane] + m_szStrides[1] * y, (width + 1) / 2);
+        }
+        return &m_frame;
+    }
+    if ((format == NVIPixel_420P10BE && target == NVIPixel_420P10LE) || (format == NVIPixel_422P10BE && target == NVIPixel_422P10LE))
+    {
+        Planes(target, width, height);
+        for (uint32_t i = 0; i < 3u; ++i)
+        {
+            const uint32_t uWidth = i == 0u ? width : (width + 1) / 2;
+            for (uint32_t y = 0; y < PlaneHeight(format, height, i); ++y)
+            {
+                kernels.Swap16(pSrc[i] + pStride[i] * y, m_pPlanes[i] + m_szStrides[i] * y, uWidth);
+            }
+        }
+        return &m_frame;
+    }
+    if ((format == NVIPixel_UYVY || format == NVIPixel_YUY2) && target == NVIPixel_422P)
+    {
+        Planes(target, width, height);
+        auto pSplit = format == NVIPixel_UYVY ? kernels.SplitUYVY : kernels.SplitYUY2;
+        // 奇数宽度时源行的最后一个像素对是完整的，亮度行按64字节对齐，多写的一个亮度字节落在行尾的填充中
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            pSplit(pSrc[0] + pStride[0] * y, m_pPlanes[0] + m_szStrides[0] * y, m_pPlanes[1] + m_szStrides[1] * y, m_pPlanes[2] + m_szStrides[2] * y,
+                   (width + 1) / 2);
+        }
+        return &m_frame;
+    }
+    if (format == NVIPixel_V210 && (target == NVIPixel_422P || target == NVIPixel_422P10LE))
+    {
+        Planes(target, width, height);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint8_t* pRow = pSrc[0] + pStride[0] * y;
+            if (target == NVIPixel_422P10LE)
+            {
+                V210ToPlanar<uint16_t, 0>(pRow, reinterpret_cast<uint16_t*>(m_pPlanes[0] + m_szStrides[0] * y),
+                                          reinterpret_cast<uint16_t*>(m_pPlanes[1] + m_szStrides[1] * y),
+                                          reinterpret_cast<uint16_t*>(m_pPlanes[2] + m_szStrides[2] * y), width);
+            }
+            else
+            {
+                V210ToPlanar<uint8_t, 2>(pRow, m_pPlanes[0] + m_szStrides[0] * y, m_pPlanes[1] + m_szStrides[1] * y, m_pPlanes[2] + m_szStrides[2] * y, width);
+            }
+        }
+        return &m_frame;
+    }
+    LOG_ERROR("Unsupported pixel conversion {} -> {}.", static_cast<int>(format), static_cast<int>(target));
+    return nullptr;
+}
+
+void AccumulateBlockSad(const uint8_t* a, const uint8_t* b, uint32_t* sums, size_t bytes)
+{
+    const size_t szBlocks = bytes / 16;
+    Kernels().SadBlocks(a, b, sums, szBlocks);
+    if (bytes % 16 != 0u)
+    {
+        sums[szBlocks] += Sad_C(a + 16 * szBlocks, b + 16 * szBlocks, bytes % 16);
+    }
+}
+
+// 8.8定点数表示的源坐标，按像素中心对齐并限制在源图像范围内
+static uint32_t SourcePosition(uint32_t index, uint32_t srcSize, uint32_t dstSize)
+{
+    const int64_t llPos = ((2ll * index + 1) * srcSize * 256) / (2ll * dstSize) - 128;
+    const int64_t llMax = (static_cast<int64_t>(srcSize) - 1) * 256;
+    return static_cast<uint32_t>(llPos < 0 ? 0 : llPos > llMax ? llMax : llPos);
+}
+
+void PlaneScaler::Scale(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, size_t dstStride, uint32_t dstWidth,
+                        uint32_t dstHeight)
+{
+    if (dstWidth == (srcWidth + 1) / 2 && dstHeight == (srcHeight + 1) / 2 && srcWidth > 1u && srcHeight > 1u)
+    {
+        Halve(src, srcStride, srcWidth, srcHeight, dst, dstStride);
+        return;
+    }
+    const PixelKernels& kernels = Kernels();
+    const bool bHorizontal = dstWidth != srcWidth;
+    if (bHorizontal)
+    {
+        m_vecTaps.resize(dstWidth);
+        for (uint32_t x = 0; x < dstWidth; ++x)
+        {
+            m_vecTaps[x] = SourcePosition(x, srcWidth, dstWidth);
+        }
+        // 多留一个像素，最右侧的插值不需要判断边界
+        m_vecRow.resize(static_cast<size_t>(srcWidth) + 1u);
+    }
+    for (uint32_t y = 0; y < dstHeight; ++y)
+    {
+        const uint32_t uPos = SourcePosition(y, srcHeight, dstHeight);
+        const uint8_t* pTop = src + srcStride * (uPos >> 8);
+        const uint32_t uWeight = uPos & 0xFFu;
+        uint8_t* pOut = bHorizontal ? m_vecRow.data() : dst + dstStride * y;
+        if (uWeight == 0u)
+        {
+            memcpy(pOut, pTop, srcWidth);
+        }
+        else
+        {
+            kernels.BlendRows(pTop, pTop + srcStride, pOut, srcWidth, uWeight);
+        }
+        if (!bHorizontal)
+        {
+            continue;
+        }
+        const uint8_t* pRow = m_vecRow.data();
+        m_vecRow[srcWidth] = m_vecRow[srcWidth - 1u];
+        uint8_t* pDst = dst + dstStride * y;
+        for (uint32_t x = 0; x < dstWidth; ++x)
+        {
+            const uint32_t uTap = m_vecTaps[x];
+            const uint8_t* pSample = pRow + (uTap >> 8);
+            const uint32_t uFrac = uTap & 0xFFu;
+            pDst[x] = static_cast<uint8_t>((pSample[0] * (256u - uFrac) + pSample[1] * uFrac + 128u) >> 8);
+        }
+    }
+}
+
+void PlaneScaler::Halve(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, size_t dstStride)
+{
+    const PixelKernels& kernels = Kernels();
+    const uint32_t uPairs = srcWidth / 2;
+    for (uint32_t y = 0; y < (srcHeight + 1) / 2; ++y)
+    {
+        // 奇数尺寸的最后一行或一列与自身求平均
+        const uint8_t* pTop = src + srcStride * (2 * y);
+        const uint8_t* pBottom = 2 * y + 1 < srcHeight ? pTop + srcStride : pTop;
+        uint8_t* pDst = dst + dstStride * y;
+        kernels.HalveRow(pTop, pBottom, pDst, uPairs);
+        if ((srcWidth & 1u) != 0u)
+        {
+            pDst[uPairs] = static_cast<uint8_t>((pTop[srcWidth - 1] + pBottom[srcWidth - 1] + 1) >> 1);
+        }
+    }
+}
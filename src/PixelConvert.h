@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <NVI/Codec.h>
+#include "StreamBuffer.h"
+
+/*
+ * 像素格式转换：将编码器不能直接使用的输入格式(NV12/NV21/V210/大端10bit/UYVY/YUY2)
+ * 一次转换为编码器原生的平面布局，运行时按CPU选择SSE4.1/AVX2/NEON实现。
+ * 转换结果写入实例持有的对齐缓存，在下一次`Convert`之前有效。
+ */
+class PixelConverter final
+{
+public:
+    const NVIVideoImageFrame* Convert(const NVIVideoImageFrame& in, uint32_t width, uint32_t height, NVIPixelFormat target);
+    static const char* KernelName();
+
+private:
+    uint8_t* Planes(NVIPixelFormat format, uint32_t width, uint32_t height);
+
+private:
+    NVIVideoImageFrame m_frame{};
+    StreamBuffer m_scratch;
+    uint8_t* m_pPlanes[3] = {};
+    size_t m_szStrides[3] = {};
+};
+
+/*
+ * 8bit平面缩放：尺寸正好减半时使用2x2均值，其余情况使用双线性插值。
+ * 双线性插值只适合缩小比例小于2的情况，更大比例应先逐级减半。
+ */
+class PlaneScaler final
+{
+public:
+    void Scale(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, size_t dstStride, uint32_t dstWidth,
+               uint32_t dstHeight);
+
+private:
+    void Halve(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, size_t dstStride);
+
+private:
+    std::vector<uint8_t> m_vecRow;  // 垂直插值的中间行
+    std::vector<uint32_t> m_vecTaps;  // 水平插值的源位置，高24bit为下标，低8bit为权重
+};
+
+// 一行数据按16字节分组累加绝对差之和，不足16字节的尾部计入最后一组
+void AccumulateBlockSad(const uint8_t* a, const uint8_t* b, uint32_t* sums, size_t bytes);
+
+bool IsPlanarFormat(NVIPixelFormat format);
+uint32_t PlaneCount(NVIPixelFormat format);
+uint32_t PlaneHeight(NVIPixelFormat format, uint32_t height, uint32_t plane);
@@ -0,0 +1,112 @@
+﻿#include "QuantMap.h"
+#include <algorithm>
+#include <cstring>
+#include "PixelConvert.h"
+
+static constexpr uint32_t kBlockSize = 16u;
+static constexpr uint32_t kStaticSad = kBlockSize * kBlockSize * 2u;  // 平均每像素差值不超过2视为噪声
+static constexpr uint8_t kStaticFrames = 4u;
+
+void QuantMap::Config(bool enable, uint32_t width, uint32_t height, uint32_t bytesPerSample, uint32_t staticQP)
+{
+    m_bEnable = enable;
+    m_bPrevious = false;
+    m_uWidth = width;
+    m_uHeight = height;
+    m_uBytesPerSample = bytesPerSample;
+    m_uBlocksX = (width + kBlockSize - 1) / kBlockSize;
+    m_uBlocksY = (height + kBlockSize - 1) / kBlockSize;
+    m_uStaticQP = staticQP;
+    m_vecRegions.clear();
+    if (!enable)
+    {
+        m_vecOffsets.clear();
+        m_vecPrevious.clear();
+        m_vecStaticFrames.clear();
+        m_vecSad.clear();
+        return;
+    }
+    const size_t szBlocks = static_cast<size_t>(m_uBlocksX) * m_uBlocksY;
+    m_vecOffsets.assign(szBlocks, 0.0f);
+    m_vecStaticFrames.assign(staticQP > 0u ? szBlocks : 0u, 0u);
+    m_vecPrevious.resize(staticQP > 0u ? static_cast<size_t>(width) * bytesPerSample * height : 0u);
+    // 每16字节一组，一个块有bytesPerSample组
+    m_vecSad.resize(staticQP > 0u ? static_cast<size_t>(m_uBlocksX) * bytesPerSample : 0u);
+}
+
+void QuantMap::SetRegions(const X2645RoiRegion* regions, uint32_t count)
+{
+    m_vecRegions.assign(regions, regions + count);
+}
+
+const float* QuantMap::Build(const uint8_t* luma, size_t stride)
+{
+    if (!m_bEnable)
+    {
+        return nullptr;
+    }
+    bool bAdjust = false;
+    if (m_uStaticQP > 0u)
+    {
+        DetectStatic(luma, stride);
+        for (size_t i = 0; i < m_vecOffsets.size(); ++i)
+        {
+            const bool bStatic = m_vecStaticFrames[i] >= kStaticFrames;
+            m_vecOffsets[i] = bStatic ? static_cast<float>(m_uStaticQP) : 0.0f;
+            bAdjust = bAdjust || bStatic;
+        }
+    }
+    else if (!m_vecRegions.empty())
+    {
+        std::fill(m_vecOffsets.begin(), m_vecOffsets.end(), 0.0f);
+    }
+    for (const X2645RoiRegion& region : m_vecRegions)
+    {
+        // 区域向外扩展到块边界
+        const uint32_t uLeft = std::min(region.x / kBlockSize, m_uBlocksX);
+        const uint32_t uTop = std::min(region.y / kBlockSize, m_uBlocksY);
+        const uint32_t uRight = std::min((std::min(region.x + region.width, m_uWidth) + kBlockSize - 1) / kBlockSize, m_uBlocksX);
+        const uint32_t uBottom = std::min((std::min(region.y + region.height, m_uHeight) + kBlockSize - 1) / kBlockSize, m_uBlocksY);
+        for (uint32_t y = uTop; y < uBottom; ++y)
+        {
+            float* pRow = m_vecOffsets.data() + static_cast<size_t>(y) * m_uBlocksX;
+            std::fill(pRow + uLeft, pRow + std::max(uLeft, uRight), static_cast<float>(region.qp_offset));
+        }
+        bAdjust = bAdjust || (uLeft < uRight && uTop < uBottom && region.qp_offset != 0);
+    }
+    return bAdjust ? m_vecOffsets.data() : nullptr;
+}
+
+void QuantMap::DetectStatic(const uint8_t* luma, size_t stride)
+{
+    const size_t szRow = static_cast<size_t>(m_uWidth) * m_uBytesPerSample;
+    for (uint32_t by = 0; by < m_uBlocksY; ++by)
+    {
+        const uint32_t uLines = std::min(kBlockSize, m_uHeight - by * kBlockSize);
+        std::fill(m_vecSad.begin(), m_vecSad.end(), 0u);
+        for (uint32_t i = 0; i < uLines; ++i)
+        {
+            const size_t szLine = static_cast<size_t>(by) * kBlockSize + i;
+            const uint8_t* pCurrent = luma + stride * szLine;
+            uint8_t* pPrevious = m_vecPrevious.data() + szRow * szLine;
+            if (m_bPrevious)
+            {
+                AccumulateBlockSad(pCurrent, pPrevious, m_vecSad.data(), szRow);
+            }
+            memcpy(pPrevious, pCurrent, szRow);
+        }
+        uint8_t* pStatic = m_vecStaticFrames.data() + static_cast<size_t>(by) * m_uBlocksX;
+        for (uint32_t bx = 0; bx < m_uBlocksX; ++bx)
+        {
+            uint32_t uSad = 0u;
+            for (uint32_t n = 0; n < m_uBytesPerSample; ++n)
+            {
+                uSad += m_vecSad[bx * m_uBytesPerSample + n];
+            }
+            // 第一帧没有参考，所有块从0开始计数
+            const bool bStatic = m_bPrevious && uSad <= kStaticSad * m_uBytesPerSample;
+            pStatic[bx] = bStatic ? static_cast<uint8_t>(std::min<uint32_t>(pStatic[bx] + 1u, 255u)) : 0u;
+        }
+    }
+    m_bPrevious = true;
+}
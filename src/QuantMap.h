@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Codec.h"
+
+/*
+ * 逐块QP偏移表：按16x16块(x264的宏块，x265 AQ的量化组)生成`quant_offsets`/`quantOffsets`，
+ * 由ROI区域和内置的静止区域检测叠加而成，ROI覆盖的块使用ROI的偏移。
+ * 静止检测逐块比较与上一帧亮度的绝对差之和，连续数帧不变的块增加QP。
+ */
+class QuantMap final
+{
+public:
+    void Config(bool enable, uint32_t width, uint32_t height, uint32_t bytesPerSample, uint32_t staticQP);
+    bool Enabled() const { return m_bEnable; }
+    void SetRegions(const X2645RoiRegion* regions, uint32_t count);
+    // 返回本帧的偏移表，没有需要调整的块时返回空
+    const float* Build(const uint8_t* luma, size_t stride);
+
+private:
+    void DetectStatic(const uint8_t* luma, size_t stride);
+
+private:
+    bool m_bEnable = false;
+    bool m_bPrevious = false;  // m_vecPrevious中保存了上一帧
+    uint32_t m_uWidth = 0u;
+    uint32_t m_uHeight = 0u;
+    uint32_t m_uBytesPerSample = 1u;
+    uint32_t m_uBlocksX = 0u;
+    uint32_t m_uBlocksY = 0u;
+    uint32_t m_uStaticQP = 0u;
+    std::vector<X2645RoiRegion> m_vecRegions;
+    std::vector<float> m_vecOffsets;
+    std::vector<uint8_t> m_vecPrevious;  // 上一帧亮度，行间距为宽度
+    std::vector<uint8_t> m_vecStaticFrames;  // 每块连续静止的帧数
+    std::vector<uint32_t> m_vecSad;
+};
@@ -0,0 +1,195 @@
+﻿#include "RtpPacketizer.h"
+#include <algorithm>
+#include <cstring>
+
+static constexpr uint8_t kStapA = 24u;
+static constexpr uint8_t kFuA = 28u;
+static constexpr uint8_t kHevcAP = 48u;
+static constexpr uint8_t kHevcFU = 49u;
+
+void RtpPacketizer::Config(uint32_t codec, uint32_t mtu)
+{
+    m_bHEVC = codec == NVICodec_HEVC;
+    m_szMTU = mtu;
+    m_vecPool.resize(m_szMTU * kPreallocPayloads);
+    m_vecRanges.reserve(kPreallocPayloads);
+    m_vecPayloads.reserve(kPreallocPayloads);
+    Reset();
+}
+
+void RtpPacketizer::Reset()
+{
+    m_szUsed = 0ull;
+    m_vecRanges.clear();
+    m_szAggregateSize = 0ull;
+    m_uAggregateCount = 0u;
+}
+
+void RtpPacketizer::Add(const uint8_t* nal, size_t size)
+{
+    // 跳过起始码
+    size_t szSkip = 0ull;
+    while (szSkip < size && nal[szSkip] == 0u)
+    {
+        ++szSkip;
+    }
+    if (szSkip < size && nal[szSkip] == 1u)
+    {
+        ++szSkip;
+    }
+    nal += szSkip;
+    size -= szSkip;
+    const size_t szHeader = m_bHEVC ? 2u : 1u;
+    if (size <= szHeader)
+    {
+        return;
+    }
+    if (size > m_szMTU)
+    {
+        CloseAggregate();
+        Fragment(nal, size);
+        return;
+    }
+    if (m_uAggregateCount > 0u && m_szAggregateSize + 2u + size > m_szMTU)
+    {
+        CloseAggregate();
+    }
+    if (m_uAggregateCount == 0u)
+    {
+        if (szHeader + 2u + size > m_szMTU)
+        {
+            // 无法与其他NAL合并，单NAL负载
+            memcpy(Append(size), nal, size);
+            m_vecRanges.push_back({m_szUsed - size, size});
+            return;
+        }
+        Append(szHeader);
+        m_szAggregateOffset = m_szUsed - szHeader;
+        m_szAggregateSize = szHeader;
+    }
+    uint8_t* pData = Append(2u + size);
+    pData[0] = static_cast<uint8_t>(size >> 8);
+    pData[1] = static_cast<uint8_t>(size);
+    memcpy(pData + 2, nal, size);
+    m_szAggregateSize += 2u + size;
+    ++m_uAggregateCount;
+}
+
+uint32_t RtpPacketizer::Finish(bool marker)
+{
+    CloseAggregate();
+    m_vecPayloads.resize(m_vecRanges.size());
+    for (size_t i = 0; i < m_vecRanges.size(); ++i)
+    {
+        X2645RtpPayload& payload = m_vecPayloads[i];
+        payload.bytes = m_vecPool.data() + m_vecRanges[i].offset;
+        payload.size = static_cast<uint32_t>(m_vecRanges[i].size);
+        payload.marker = 0u;
+    }
+    if (marker && !m_vecPayloads.empty())
+    {
+        m_vecPayloads.back().marker = 1u;
+    }
+    return static_cast<uint32_t>(m_vecPayloads.size());
+}
+
+uint8_t* RtpPacketizer::Append(size_t size)
+{
+    if (m_szUsed + size > m_vecPool.size())
+    {
+        m_vecPool.resize(std::max(m_vecPool.size() * 2u, m_szUsed + size));
+    }
+    uint8_t* pData = m_vecPool.data() + m_szUsed;
+    m_szUsed += size;
+    return pData;
+}
+
+void RtpPacketizer::Fragment(const uint8_t* nal, size_t size)
+{
+    const size_t szHeader = m_bHEVC ? 2u : 1u;
+    const size_t szChunk = m_szMTU - szHeader - 1u;
+    uint8_t indicator[3] = {};
+    uint8_t uType = 0u;
+    if (m_bHEVC)
+    {
+        // PayloadHdr保留F、LayerId、TID，Type改为FU
+        indicator[0] = static_cast<uint8_t>((nal[0] & 0x81u) | (kHevcFU << 1));
+        indicator[1] = nal[1];
+        uType = static_cast<uint8_t>((nal[0] >> 1) & 0x3Fu);
+    }
+    else
+    {
+        indicator[0] = static_cast<uint8_t>((nal[0] & 0xE0u) | kFuA);
+        uType = static_cast<uint8_t>(nal[0] & 0x1Fu);
+    }
+    // NAL头不进入分片
+    for (size_t szOffset = szHeader; szOffset < size; szOffset += szChunk)
+    {
+        const size_t szData = std::min(szChunk, size - szOffset);
+        indicator[szHeader] = uType;
+        if (szOffset == szHeader)
+        {
+            indicator[szHeader] |= 0x80u;  // S
+        }
+        if (szOffset + szData == size)
+        {
+            indicator[szHeader] |= 0x40u;  // E
+        }
+        uint8_t* pData = Append(szHeader + 1u + szData);
+        memcpy(pData, indicator, szHeader + 1u);
+        memcpy(pData + szHeader + 1u, nal + szOffset, szData);
+        m_vecRanges.push_back({m_szUsed - szHeader - 1u - szData, szHeader + 1u + szData});
+    }
+}
+
+void RtpPacketizer::CloseAggregate()
+{
+    if (m_uAggregateCount == 0u)
+    {
+        return;
+    }
+    const size_t szHeader = m_bHEVC ? 2u : 1u;
+    uint8_t* pAggregate = m_vecPool.data() + m_szAggregateOffset;
+    if (m_uAggregateCount == 1u)
+    {
+        // 只有一个NAL时跳过预留的头部和长度，作为单NAL负载
+        m_vecRanges.push_back({m_szAggregateOffset + szHeader + 2u, m_szAggregateSize - szHeader - 2u});
+    }
+    else if (m_bHEVC)
+    {
+        // F为各NAL的或，LayerId和TID取最小值
+        uint8_t uForbidden = 0u;
+        uint8_t uLayer = 0x3Fu;
+        uint8_t uTid = 0x07u;
+        for (size_t szOffset = szHeader; szOffset < m_szAggregateSize;)
+        {
+            const size_t szNal = (static_cast<size_t>(pAggregate[szOffset]) << 8) | pAggregate[szOffset + 1];
+            const uint8_t* pNal = pAggregate + szOffset + 2;
+            uForbidden |= pNal[0] & 0x80u;
+            uLayer = std::min(uLayer, static_cast<uint8_t>(((pNal[0] & 0x01u) << 5) | (pNal[1] >> 3)));
+            uTid = std::min(uTid, static_cast<uint8_t>(pNal[1] & 0x07u));
+            szOffset += 2u + szNal;
+        }
+        pAggregate[0] = static_cast<uint8_t>(uForbidden | (kHevcAP << 1) | (uLayer >> 5));
+        pAggregate[1] = static_cast<uint8_t>(((uLayer & 0x1Fu) << 3) | uTid);
+        m_vecRanges.push_back({m_szAggregateOffset, m_szAggregateSize});
+    }
+    else
+    {
+        // F为各NAL的或，NRI取最大值
+        uint8_t uForbidden = 0u;
+        uint8_t uNRI = 0u;
+        for (size_t szOffset = szHeader; szOffset < m_szAggregateSize;)
+        {
+            const size_t szNal = (static_cast<size_t>(pAggregate[szOffset]) << 8) | pAggregate[szOffset + 1];
+            const uint8_t* pNal = pAggregate + szOffset + 2;
+            uForbidden |= pNal[0] & 0x80u;
+            uNRI = std::max(uNRI, static_cast<uint8_t>(pNal[0] & 0x60u));
+            szOffset += 2u + szNal;
+        }
+        pAggregate[0] = static_cast<uint8_t>(uForbidden | uNRI | kStapA);
+        m_vecRanges.push_back({m_szAggregateOffset, m_szAggregateSize});
+    }
+    m_szAggregateSize = 0ull;
+    m_uAggregateCount = 0u;
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Codec.h"
+
+/*
+ * RTP负载打包(RFC 6184 / RFC 7798 非交错模式)：直接使用编码器给出的NAL边界，
+ * 负载写入预分配的缓存，一批NAL(一帧或一个slice)打包完成后一次输出。
+ * 一个实例同时只能在一个线程中使用，多Slice模式下每个slice使用独立的实例。
+ */
+class RtpPacketizer final
+{
+public:
+    void Config(uint32_t codec, uint32_t mtu);
+    // 开始新的一批，之前输出的负载失效
+    void Reset();
+    // 加入一个Annex-B NAL(含起始码)
+    void Add(const uint8_t* nal, size_t size);
+    // 结束当前一批，marker为真时最后一个负载置M位，返回负载数
+    uint32_t Finish(bool marker);
+    const X2645RtpPayload* Payloads() const { return m_vecPayloads.data(); }
+    size_t Bytes() const { return m_szUsed; }
+
+private:
+    struct Range
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    uint8_t* Append(size_t size);
+    void Fragment(const uint8_t* nal, size_t size);
+    void CloseAggregate();
+
+private:
+    bool m_bHEVC = false;
+    size_t m_szMTU = 1200u;
+    std::vector<uint8_t> m_vecPool;
+    size_t m_szUsed = 0ull;
+    std::vector<Range> m_vecRanges;
+    std::vector<X2645RtpPayload> m_vecPayloads;
+    // 正在合并的STAP-A/AP，第一个NAL前预留了头部和长度字段
+    size_t m_szAggregateOffset = 0ull;
+    size_t m_szAggregateSize = 0ull;
+    uint32_t m_uAggregateCount = 0u;
+
+    static constexpr size_t kPreallocPayloads = 64u;
+};
@@ -0,0 +1,249 @@
+﻿#include "SliceDelivery.h"
+#include <cstring>
+#include "adaption/Clock.h"
+#include "adaption/Trace.h"
+
+SliceDelivery::~SliceDelivery()
+{
+    Stop();
+}
+
+void SliceDelivery::Start(size_t queues)
+{
+    Stop();
+    if (queues != m_szQueues)
+    {
+        m_pQueues.reset(new Queue[queues]);
+        m_szQueues = queues;
+    }
+    for (size_t i = 0; i < m_szQueues; ++i)
+    {
+        m_pQueues[i].head.store(0u, std::memory_order_relaxed);
+        m_pQueues[i].tail.store(0u, std::memory_order_relaxed);
+    }
+    m_uFrames = 0u;
+    m_uEnded.store(0u, std::memory_order_relaxed);
+    m_uDone.store(0u, std::memory_order_relaxed);
+    m_uFrame = 0u;
+    m_szSlice = 0u;
+    m_bStop.store(false, std::memory_order_relaxed);
+    m_bOverflow.store(false, std::memory_order_relaxed);
+    m_uDelivered.store(0u, std::memory_order_relaxed);
+    m_uDropped.store(0u, std::memory_order_relaxed);
+    m_uWaitTotal.store(0u, std::memory_order_relaxed);
+    m_uWaitMax.store(0u, std::memory_order_relaxed);
+    m_uCallbackTotal.store(0u, std::memory_order_relaxed);
+    m_uCallbackMax.store(0u, std::memory_order_relaxed);
+    m_thread = std::thread(&SliceDelivery::Process, this);
+}
+
+void SliceDelivery::Stop()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop.store(true, std::memory_order_release);
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void SliceDelivery::EndFrame()
+{
+    m_uEnded.store(m_uFrames, std::memory_order_release);
+    Wake();
+}
+
+bool SliceDelivery::Push(size_t queue, uint64_t frame, const NVIVideoEncodedPacket& packet, bool last, NVIVideoEncode::OnPacket out, void* user)
+{
+    Queue& item = m_pQueues[queue < m_szQueues ? queue : m_szQueues - 1u];
+    const uint64_t uTail = item.tail.load(std::memory_order_relaxed);
+    if (uTail - item.head.load(std::memory_order_acquire) >= kQueueDepth)
+    {
+        m_uDropped.fetch_add(1u, std::memory_order_relaxed);
+        m_bOverflow.store(true, std::memory_order_release);
+        return false;
+    }
+    Entry& entry = item.entries[uTail & (kQueueDepth - 1u)];
+    entry.packet = packet;
+    if (packet.buffer.size > 0u)
+    {
+        TRACE_SCOPE("copy", packet.buffer.size);
+        uint8_t* pData = entry.data.Reserve(packet.buffer.size);
+        memcpy(pData, packet.buffer.bytes, packet.buffer.size);
+        entry.data.Commit(packet.buffer.size);
+        entry.packet.buffer.bytes = pData;
+    }
+    entry.out = out;
+    entry.user = user;
+    entry.ready = SteadyNanoseconds();
+    entry.frame = frame;
+    entry.last = last;
+    item.tail.store(uTail + 1u, std::memory_order_release);
+    Wake();
+    return true;
+}
+
+void SliceDelivery::Drain()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+    const uint64_t uEnded = m_uEnded.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this, uEnded]() { return m_uDone.load(std::memory_order_acquire) >= uEnded; });
+}
+
+bool SliceDelivery::Stats(X2645SliceDeliveryStats& stats) const
+{
+    if (m_szQueues == 0u)
+    {
+        return false;
+    }
+    stats = {};
+    stats.delivered = m_uDelivered.load(std::memory_order_relaxed);
+    stats.dropped = m_uDropped.load(std::memory_order_relaxed);
+    if (stats.delivered > 0u)
+    {
+        stats.wait_avg_ns = m_uWaitTotal.load(std::memory_order_relaxed) / stats.delivered;
+        stats.callback_avg_ns = m_uCallbackTotal.load(std::memory_order_relaxed) / stats.delivered;
+    }
+    stats.wait_max_ns = m_uWaitMax.load(std::memory_order_relaxed);
+    stats.callback_max_ns = m_uCallbackMax.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < m_szQueues; ++i)
+    {
+        const uint64_t uHead = m_pQueues[i].head.load(std::memory_order_relaxed);
+        const uint64_t uTail = m_pQueues[i].tail.load(std::memory_order_relaxed);
+        stats.pending += static_cast<uint32_t>(uTail > uHead ? uTail - uHead : 0u);
+    }
+    return true;
+}
+
+void SliceDelivery::Process()
+{
+    while (true)
+    {
+        DeliverReady();
+        if (m_bStop.load(std::memory_order_acquire))
+        {
+            DeliverReady();  // 停止前结束的帧都已可见
+            break;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_bSleeping.store(true, std::memory_order_relaxed);
+        // 与生产者的入队、Wake中的检查构成对称的屏障，入队后要么这里看到数据，要么生产者看到休眠标志
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (Blocked() && !m_bStop.load(std::memory_order_relaxed))
+        {
+            m_idle.notify_all();
+            m_wake.wait(lock);
+        }
+        m_bSleeping.store(false, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_idle.notify_all();
+}
+
+void SliceDelivery::DeliverReady()
+{
+    while (true)
+    {
+        // 先读帧结束的序号再查看队列，帧结束前入队的slice一定可见
+        const uint64_t uEnded = m_uEnded.load(std::memory_order_acquire);
+        Queue& item = m_pQueues[m_szSlice];
+        const uint64_t uHead = item.head.load(std::memory_order_relaxed);
+        if (uHead != item.tail.load(std::memory_order_acquire))
+        {
+            Entry& entry = item.entries[uHead & (kQueueDepth - 1u)];
+            if (entry.frame <= m_uFrame)
+            {
+                const bool bCurrent = entry.frame == m_uFrame;
+                const bool bLast = entry.last;
+                if (bCurrent)
+                {
+                    Deliver(entry);
+                }
+                item.head.store(uHead + 1u, std::memory_order_release);
+                if (!bCurrent)
+                {
+                    continue;
+                }
+                if (bLast)
+                {
+                    NextFrame();
+                }
+                else if (m_szQueues > 1u)
+                {
+                    NextSlice();
+                }
+                continue;
+            }
+        }
+        if (m_uFrame >= uEnded)
+        {
+            return;
+        }
+        // 当前帧已结束但这个slice不在队列中，已被丢弃
+        NextSlice();
+    }
+}
+
+void SliceDelivery::Deliver(Entry& entry)
+{
+    const int64_t nBegin = SteadyNanoseconds();
+    if (entry.out)
+    {
+        TRACE_SCOPE("output", entry.packet.buffer.size);
+        entry.out(&entry.packet, entry.user);
+    }
+    const uint64_t uWait = static_cast<uint64_t>(nBegin > entry.ready ? nBegin - entry.ready : 0);
+    const uint64_t uCallback = static_cast<uint64_t>(SteadyNanoseconds() - nBegin);
+    // 统计只由交付线程写入
+    m_uDelivered.fetch_add(1u, std::memory_order_relaxed);
+    m_uWaitTotal.fetch_add(uWait, std::memory_order_relaxed);
+    m_uCallbackTotal.fetch_add(uCallback, std::memory_order_relaxed);
+    if (uWait > m_uWaitMax.load(std::memory_order_relaxed))
+    {
+        m_uWaitMax.store(uWait, std::memory_order_relaxed);
+    }
+    if (uCallback > m_uCallbackMax.load(std::memory_order_relaxed))
+    {
+        m_uCallbackMax.store(uCallback, std::memory_order_relaxed);
+    }
+}
+
+bool SliceDelivery::Blocked() const
+{
+    const Queue& item = m_pQueues[m_szSlice];
+    return m_uFrame >= m_uEnded.load(std::memory_order_relaxed) &&
+           item.head.load(std::memory_order_relaxed) == item.tail.load(std::memory_order_relaxed);
+}
+
+void SliceDelivery::NextSlice()
+{
+    if (++m_szSlice >= m_szQueues)
+    {
+        NextFrame();
+    }
+}
+
+void SliceDelivery::NextFrame()
+{
+    ++m_uFrame;
+    m_szSlice = 0u;
+    m_uDone.store(m_uFrame, std::memory_order_release);
+}
+
+void SliceDelivery::Wake()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_bSleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wake.notify_one();
+    }
+}
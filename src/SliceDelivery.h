@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "Codec.h"
+#include "StreamBuffer.h"
+
+/*
+ * 有序交付：每个slice一个单生产者单消费者的无锁环形队列，编码slice的线程只拷贝数据后返回，
+ * 交付线程按帧、按slice顺序回调，前面的slice都已回调后立即回调下一个，不等待整帧。
+ * 队列满时丢弃该slice并计数，由编码器在下一帧强制IDR；帧结束后仍缺少的slice视为已丢弃并跳过。
+ * 同一个slice序号在相邻两帧可能由不同线程编码，x264返回前等待所有slice线程，生产者之间已有先后关系。
+ */
+class SliceDelivery final
+{
+public:
+    ~SliceDelivery();
+
+public:
+    // queues为固定slice布局的slice数，slice数逐帧变化时为1(只在编码线程中回调)；已启动时先停止
+    void Start(size_t queues);
+    // 回调剩余的slice后结束交付线程
+    void Stop();
+    bool Running() const { return m_thread.joinable(); }
+    // 以下两个在编码线程中调用，返回当前帧的序号
+    uint64_t BeginFrame() { return m_uFrames++; }
+    // 当前帧的slice都已入队或丢弃
+    void EndFrame();
+    // 在编码slice的线程中调用，packet的数据被拷贝，队列满时返回false
+    bool Push(size_t queue, uint64_t frame, const NVIVideoEncodedPacket& packet, bool last, NVIVideoEncode::OnPacket out, void* user);
+    // 等待已结束的帧全部回调，不能在回调中调用
+    void Drain();
+    // 上次查询后是否丢弃过slice
+    bool TakeOverflow() { return m_bOverflow.exchange(false, std::memory_order_acq_rel); }
+    bool Stats(X2645SliceDeliveryStats& stats) const;
+
+private:
+    struct Entry
+    {
+        NVIVideoEncodedPacket packet{};
+        StreamBuffer data;
+        NVIVideoEncode::OnPacket out = nullptr;
+        void* user = nullptr;
+        int64_t ready = 0;
+        uint64_t frame = 0u;
+        bool last = false;
+    };
+    static constexpr size_t kQueueDepth = 8u;  // 2的幂，每个slice最多积压的帧数
+    struct Queue
+    {
+        alignas(64) std::atomic<uint64_t> head{0u};  // 交付线程写
+        alignas(64) std::atomic<uint64_t> tail{0u};  // 生产者写
+        Entry entries[kQueueDepth];
+    };
+
+    void Process();
+    void DeliverReady();
+    void Deliver(Entry& entry);
+    bool Blocked() const;
+    void NextSlice();
+    void NextFrame();
+    void Wake();
+
+private:
+    std::unique_ptr<Queue[]> m_pQueues;
+    size_t m_szQueues = 0u;
+    uint64_t m_uFrames = 0u;  // 编码线程
+    alignas(64) std::atomic<uint64_t> m_uEnded{0u};
+    alignas(64) std::atomic<uint64_t> m_uDone{0u};  // 已回调完的帧数
+    uint64_t m_uFrame = 0u;  // 交付线程当前的帧和slice
+    size_t m_szSlice = 0u;
+    std::atomic<bool> m_bStop{false};
+    std::atomic<bool> m_bSleeping{false};
+    std::atomic<bool> m_bOverflow{false};
+    std::atomic<uint64_t> m_uDelivered{0u};
+    std::atomic<uint64_t> m_uDropped{0u};
+    std::atomic<uint64_t> m_uWaitTotal{0u};
+    std::atomic<uint64_t> m_uWaitMax{0u};
+    std::atomic<uint64_t> m_uCallbackTotal{0u};
+    std::atomic<uint64_t> m_uCallbackMax{0u};
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::thread m_thread;
+};
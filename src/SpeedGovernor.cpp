@@ -0,0 +1,93 @@
+﻿#include "SpeedGovernor.h"
+#include <algorithm>
+#include "adaption/Logging.h"
+
+static constexpr double kSmoothing = 0.125;
+static constexpr double kRaiseRatio = 0.6;
+static constexpr uint32_t kHoldFrames = 8u;
+static constexpr uint32_t kCalmFrames = 30u;
+static constexpr uint32_t kMaxCalmFrames = 960u;
+
+void SpeedGovernor::Config(const X2645SpeedGovernorConfig* config)
+{
+    m_bEnable = config != nullptr;
+    m_report = config ? config->report : nullptr;
+    m_pUser = config ? config->user : nullptr;
+    m_dTarget = config && config->target > 0u ? config->target / 100.0 : 0.8;
+    m_uMinLevel = config ? config->min_level : 0u;
+    m_uMaxLevel = config && config->max_level > 0u ? config->max_level : X2645_SPEED_LEVELS - 1u;
+    m_bPrimed = false;
+    m_uHold = 0u;
+    m_uCalm = 0u;
+    m_uCalmRequired = kCalmFrames;
+    m_uSinceRaise = kMaxCalmFrames;
+}
+
+void SpeedGovernor::Reset(uint32_t level)
+{
+    m_uLevel = level;
+    m_bPrimed = false;
+    m_uHold = 0u;
+    m_uCalm = 0u;
+}
+
+bool SpeedGovernor::Update(int64_t nanoseconds, uint32_t fpsNum, uint32_t fpsDen, uint32_t& level)
+{
+    if (fpsNum == 0u || fpsDen == 0u)
+    {
+        return false;
+    }
+    const double dLoad = static_cast<double>(nanoseconds) * fpsNum / (1e9 * fpsDen);
+    m_dLoad = m_bPrimed ? m_dLoad + (dLoad - m_dLoad) * kSmoothing : dLoad;
+    m_bPrimed = true;
+    m_uSinceRaise = std::min(m_uSinceRaise + 1u, kMaxCalmFrames);
+    // 配置修改了级别范围
+    if (m_uLevel < m_uMinLevel || m_uLevel > m_uMaxLevel)
+    {
+        level = std::min(std::max(m_uLevel, m_uMinLevel), m_uMaxLevel);
+        return true;
+    }
+    if (m_uHold > 0u)
+    {
+        --m_uHold;
+        return false;
+    }
+    if ((dLoad > 1.0 || m_dLoad > m_dTarget) && m_uLevel > m_uMinLevel)
+    {
+        level = m_uLevel - 1u;
+        return true;
+    }
+    m_uCalm = m_dLoad < m_dTarget * kRaiseRatio ? m_uCalm + 1u : 0u;
+    if (m_uCalm >= m_uCalmRequired && m_uLevel < m_uMaxLevel)
+    {
+        level = m_uLevel + 1u;
+        return true;
+    }
+    if (m_uSinceRaise >= kMaxCalmFrames)
+    {
+        m_uCalmRequired = kCalmFrames;  // 长时间稳定后恢复升级的灵敏度
+    }
+    return false;
+}
+
+void SpeedGovernor::Commit(uint32_t level)
+{
+    const uint32_t uPrevious = m_uLevel;
+    if (level < uPrevious && m_uSinceRaise < m_uCalmRequired)
+    {
+        m_uCalmRequired = std::min(m_uCalmRequired * 2u, kMaxCalmFrames);
+    }
+    if (level > uPrevious)
+    {
+        m_uSinceRaise = 0u;
+    }
+    m_uLevel = level;
+    m_uHold = kHoldFrames;
+    m_uCalm = 0u;
+    const uint32_t uLoad = static_cast<uint32_t>(m_dLoad * 100.0 + 0.5);
+    LOG_NOTICE("X2645 speed level {} -> {}, load {}%.", uPrevious, level, uLoad);
+    if (m_report)
+    {
+        m_report(level, uPrevious, uLoad, m_pUser);
+    }
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <cstdint>
+#include "Codec.h"
+
+/*
+ * 编码速度调节：按帧率计算每帧的时间预算，统计`Encoding`耗时占预算的比例(负载)。
+ * 负载超过目标或单帧超时立即降一级；负载长时间低于目标的60%才升一级。
+ * 调整后保持数帧不再判断，升级后很快又降级时加倍下次升级需要的平稳帧数。
+ */
+class SpeedGovernor final
+{
+public:
+    void Config(const X2645SpeedGovernorConfig* config);
+    bool Enabled() const { return m_bEnable; }
+    uint32_t Level() const { return m_uLevel; }
+    // 编码器重新打开后回到默认级别
+    void Reset(uint32_t level);
+    // 返回true表示需要切换到level
+    bool Update(int64_t nanoseconds, uint32_t fpsNum, uint32_t fpsDen, uint32_t& level);
+    // 编码器已切换到level，记录并通知调用者
+    void Commit(uint32_t level);
+
+private:
+    bool m_bEnable = false;
+    double m_dTarget = 0.8;
+    double m_dLoad = 0.0;  // 负载的指数平均
+    bool m_bPrimed = false;
+    uint32_t m_uLevel = X2645_SPEED_DEFAULT;
+    uint32_t m_uMinLevel = 0u;
+    uint32_t m_uMaxLevel = X2645_SPEED_LEVELS - 1u;
+    uint32_t m_uHold = 0u;
+    uint32_t m_uCalm = 0u;
+    uint32_t m_uCalmRequired = 0u;
+    uint32_t m_uSinceRaise = 0u;
+    X2645OnSpeedLevel m_report = nullptr;
+    void* m_pUser = nullptr;
+};
@@ -0,0 +1,160 @@
+﻿#include "StreamBuffer.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+static constexpr std::align_val_t kBufferAlign{64};
+
+StreamBufferPool& StreamBufferPool::Instance()
+{
+    static StreamBufferPool s_pool;
+    return s_pool;
+}
+
+StreamBufferPool::~StreamBufferPool()
+{
+    for (auto& vecFree : m_vecFree)
+    {
+        for (uint8_t* pData : vecFree)
+        {
+            ::operator delete[](pData, kBufferAlign);
+        }
+    }
+}
+
+size_t StreamBufferPool::SizeClass(size_t size, size_t& index)
+{
+    for (index = 0; index < kClassCount; ++index)
+    {
+        const size_t szClass = size_t(1) << (kMinClassBits + index);
+        if (size <= szClass)
+        {
+            return szClass;
+        }
+    }
+    // 超过最大等级的缓存按1MB对齐直接分配，不进入缓存池
+    const size_t kAlign = size_t(1) << 20;
+    return (size + kAlign - 1) & ~(kAlign - 1);
+}
+
+uint8_t* StreamBufferPool::Acquire(size_t& size)
+{
+    size_t index = 0;
+    size = SizeClass(size, index);
+    if (index < kClassCount)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& vecFree = m_vecFree[index];
+        if (!vecFree.empty())
+        {
+            uint8_t* pData = vecFree.back();
+            vecFree.pop_back();
+            m_szPooled -= size;
+            return pData;
+        }
+    }
+    return static_cast<uint8_t*>(::operator new[](size, kBufferAlign));
+}
+
+void StreamBufferPool::Recycle(uint8_t* data, size_t size)
+{
+    if (data == nullptr)
+    {
+        return;
+    }
+    size_t index = 0;
+    if (SizeClass(size, index) == size && index < kClassCount)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& vecFree = m_vecFree[index];
+        if (vecFree.size() < kMaxPooled)
+        {
+            vecFree.push_back(data);
+            m_szPooled += size;
+            return;
+        }
+    }
+    ::operator delete[](data, kBufferAlign);
+}
+
+size_t StreamBufferPool::PooledBytes()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_szPooled;
+}
+
+//////////////////////////////////////////////////////////////////////////
+StreamBuffer::~StreamBuffer()
+{
+    Reset();
+}
+
+StreamBuffer::StreamBuffer(StreamBuffer&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+StreamBuffer& StreamBuffer::operator=(StreamBuffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        Reset();
+        std::swap(m_pData, other.m_pData);
+        std::swap(m_szCapacity, other.m_szCapacity);
+        std::swap(m_szHighWater, other.m_szHighWater);
+        std::swap(m_szWindowPeak, other.m_szWindowPeak);
+        std::swap(m_szShrinkTo, other.m_szShrinkTo);
+        std::swap(m_uWindowFrames, other.m_uWindowFrames);
+    }
+    return *this;
+}
+
+uint8_t* StreamBuffer::Reserve(size_t size, size_t keep)
+{
+    if (m_szShrinkTo > 0ull && keep == 0ull && size <= m_szShrinkTo)
+    {
+        StreamBufferPool::Instance().Recycle(m_pData, m_szCapacity);
+        m_szCapacity = m_szShrinkTo;
+        m_pData = StreamBufferPool::Instance().Acquire(m_szCapacity);
+    }
+    m_szShrinkTo = 0ull;
+    if (size > m_szCapacity)
+    {
+        // 按1.5倍增长，减少大帧连续出现时的反复扩容
+        size_t szCapacity = std::max(size, m_szCapacity + m_szCapacity / 2);
+        uint8_t* pData = StreamBufferPool::Instance().Acquire(szCapacity);
+        if (m_pData && keep > 0ull)
+        {
+            memcpy(pData, m_pData, std::min(keep, m_szCapacity));
+        }
+        StreamBufferPool::Instance().Recycle(m_pData, m_szCapacity);
+        m_pData = pData;
+        m_szCapacity = szCapacity;
+    }
+    return m_pData;
+}
+
+void StreamBuffer::Commit(size_t used)
+{
+    m_szHighWater = std::max(m_szHighWater, used);
+    m_szWindowPeak = std::max(m_szWindowPeak, used);
+    if (++m_uWindowFrames >= kShrinkFrames)
+    {
+        if (m_szWindowPeak < m_szCapacity / 4)
+        {
+            m_szShrinkTo = std::max(m_szWindowPeak * 2, size_t(1));
+        }
+        m_szWindowPeak = 0ull;
+        m_uWindowFrames = 0u;
+    }
+}
+
+void StreamBuffer::Reset()
+{
+    StreamBufferPool::Instance().Recycle(m_pData, m_szCapacity);
+    m_pData = nullptr;
+    m_szCapacity = 0ull;
+    m_szWindowPeak = 0ull;
+    m_szShrinkTo = 0ull;
+    m_uWindowFrames = 0u;
+}
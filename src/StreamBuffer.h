@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+ * 进程级的码流缓存池，按2的幂划分尺寸等级(64KB ~ 64MB)，
+ * 各编码器释放或收缩的缓存回到池中供其他实例复用。
+ */
+class StreamBufferPool final
+{
+public:
+    static StreamBufferPool& Instance();
+
+public:
+    uint8_t* Acquire(size_t& size);
+    void Recycle(uint8_t* data, size_t size);
+    size_t PooledBytes();
+
+private:
+    StreamBufferPool() = default;
+    ~StreamBufferPool();
+    static size_t SizeClass(size_t size, size_t& index);
+
+private:
+    static constexpr size_t kMinClassBits = 16u;
+    static constexpr size_t kClassCount = 11u;
+    static constexpr size_t kMaxPooled = 8u;
+
+    std::mutex m_mutex;
+    std::vector<uint8_t*> m_vecFree[kClassCount];
+    size_t m_szPooled = 0ull;
+};
+
+/*
+ * 单路码流缓存：按需增长，低码率下连续一段时间用量不足容量的1/4时收缩，
+ * 收缩在下一次`Reserve`时进行，保证已输出的数据在下一帧之前有效。
+ */
+class StreamBuffer final
+{
+public:
+    StreamBuffer() = default;
+    ~StreamBuffer();
+    StreamBuffer(StreamBuffer&& other) noexcept;
+    StreamBuffer& operator=(StreamBuffer&& other) noexcept;
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+public:
+    uint8_t* Data() const { return m_pData; }
+    size_t Capacity() const { return m_szCapacity; }
+    size_t HighWater() const { return m_szHighWater; }
+    uint8_t* Reserve(size_t size, size_t keep = 0ull);
+    void Commit(size_t used);
+    void Reset();
+
+private:
+    uint8_t* m_pData = nullptr;
+    size_t m_szCapacity = 0ull;
+    size_t m_szHighWater = 0ull;
+    size_t m_szWindowPeak = 0ull;
+    size_t m_szShrinkTo = 0ull;
+    uint32_t m_uWindowFrames = 0u;
+
+    static constexpr uint32_t kShrinkFrames = 600u;
+};
@@ -0,0 +1,644 @@
+﻿#include "StreamMuxer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "adaption/Logging.h"
+
+static constexpr size_t kTsPacket = 188u;
+static constexpr uint16_t kPmtPid = 0x1000u;
+static constexpr uint16_t kVideoPid = 0x100u;
+static constexpr uint64_t kTsBaseTime = 126000u;  // 90kHz，PTS/DTS整体后移1.4秒，给PCR留出提前量
+static constexpr uint64_t kPcrLead = 9000u;       // PCR比DTS早100ms
+static constexpr uint32_t kKeySampleFlags = 0x02000000u;    // sample_depends_on = 2
+static constexpr uint32_t kDeltaSampleFlags = 0x01010000u;  // sample_depends_on = 1, sample_is_non_sync_sample
+static constexpr uint8_t kAvcAUD[6] = {0u, 0u, 0u, 1u, 0x09u, 0xF0u};
+static constexpr uint8_t kHevcAUD[7] = {0u, 0u, 0u, 1u, 0x46u, 0x01u, 0x50u};
+static constexpr uint32_t kUnityMatrix[9] = {0x00010000u, 0u, 0u, 0u, 0x00010000u, 0u, 0u, 0u, 0x40000000u};
+
+static void PutU8(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void PutU16(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void PutU32(std::vector<uint8_t>& out, uint32_t value)
+{
+    PutU16(out, value >> 16);
+    PutU16(out, value & 0xFFFFu);
+}
+
+static void PutU64(std::vector<uint8_t>& out, uint64_t value)
+{
+    PutU32(out, static_cast<uint32_t>(value >> 32));
+    PutU32(out, static_cast<uint32_t>(value));
+}
+
+static void PutFourCC(std::vector<uint8_t>& out, const char* type)
+{
+    out.insert(out.end(), type, type + 4);
+}
+
+static void WriteU32(uint8_t* data, size_t value)
+{
+    data[0] = static_cast<uint8_t>(value >> 24);
+    data[1] = static_cast<uint8_t>(value >> 16);
+    data[2] = static_cast<uint8_t>(value >> 8);
+    data[3] = static_cast<uint8_t>(value);
+}
+
+static size_t BeginBox(std::vector<uint8_t>& out, const char* type)
+{
+    const size_t szOffset = out.size();
+    PutU32(out, 0u);
+    PutFourCC(out, type);
+    return szOffset;
+}
+
+static size_t BeginFullBox(std::vector<uint8_t>& out, const char* type, uint32_t version, uint32_t flags)
+{
+    const size_t szOffset = BeginBox(out, type);
+    PutU32(out, (version << 24) | flags);
+    return szOffset;
+}
+
+static void EndBox(std::vector<uint8_t>& out, size_t offset)
+{
+    WriteU32(out.data() + offset, out.size() - offset);
+}
+
+// ISO/IEC 13818-1 PSI使用的CRC32(不反转，初值全1)
+static uint32_t Crc32Mpeg(const uint8_t* data, size_t size)
+{
+    uint32_t uCrc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i)
+    {
+        uCrc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int n = 0; n < 8; ++n)
+        {
+            uCrc = (uCrc & 0x80000000u) ? (uCrc << 1) ^ 0x04C11DB7u : uCrc << 1;
+        }
+    }
+    return uCrc;
+}
+
+static void PutSection(std::vector<uint8_t>& out, uint16_t pid, const std::vector<uint8_t>& section)
+{
+    const size_t szPacket = out.size();
+    PutU8(out, 0x47u);
+    PutU16(out, 0x4000u | pid);  // payload_unit_start_indicator
+    PutU8(out, 0x10u);           // 只有负载，continuity_counter输出时填写
+    PutU8(out, 0u);              // pointer_field
+    out.insert(out.end(), section.begin(), section.end());
+    PutU32(out, Crc32Mpeg(section.data(), section.size()));
+    out.resize(szPacket + kTsPacket, 0xFFu);
+}
+
+static void WriteTimestamp(uint8_t* data, uint32_t prefix, uint64_t value)
+{
+    data[0] = static_cast<uint8_t>((prefix << 4) | ((value >> 29) & 0x0Eu) | 1u);
+    data[1] = static_cast<uint8_t>(value >> 22);
+    data[2] = static_cast<uint8_t>(((value >> 14) & 0xFEu) | 1u);
+    data[3] = static_cast<uint8_t>(value >> 7);
+    data[4] = static_cast<uint8_t>(((value << 1) & 0xFEu) | 1u);
+}
+
+StreamMuxer::~StreamMuxer()
+{
+    Finish();
+}
+
+void StreamMuxer::Config(const X2645MuxConfig* config)
+{
+    Finish();
+    m_config = config ? *config : X2645MuxConfig{};
+    if (m_config.buffer_size == 0u)
+    {
+        m_config.buffer_size = static_cast<uint32_t>(kDefaultBufferSize);
+    }
+}
+
+bool StreamMuxer::Open(const NVIVideoCodecParam& param, uint32_t delay, bool inband, const X2645StreamHeaders& headers)
+{
+    Finish();
+    if (!Configured() || param.frame_rate_num == 0u || param.frame_rate_den == 0u)
+    {
+        return false;
+    }
+    m_bHEVC = param.codec == NVICodec_HEVC;
+    m_bInband = inband;
+    if (m_config.timescale > 0u)
+    {
+        m_uTimescale = m_config.timescale;
+        m_nFrameDuration = std::max<int64_t>(static_cast<int64_t>(m_uTimescale) * param.frame_rate_den / param.frame_rate_num, 1);
+    }
+    else
+    {
+        m_uTimescale = param.frame_rate_num;
+        m_nFrameDuration = param.frame_rate_den;
+    }
+    m_nDelay = static_cast<int64_t>(delay) * m_nFrameDuration;
+    m_nLastDts = 0;
+    m_nSegmentDts = 0;
+    m_uFrames = 0u;
+    m_uSequence = 0u;
+    m_bSegmentStart = false;
+    m_bWriteFailed = false;
+    m_szUsed = 0ull;
+    m_szPacketFill = 0ull;
+    m_uVideoCounter = 0u;
+    m_uPsiCounter = 0u;
+    m_vecSamples.clear();
+    m_vecHeaders.assign(headers.nals, headers.nals + headers.nals_size);
+    m_buffer.Reserve(m_config.buffer_size);
+    m_bOpened = true;
+    if (m_config.format == X2645Mux_FMP4)
+    {
+        WriteInit(param, headers);
+        Output(m_vecBox.data(), m_vecBox.size(), X2645MuxFlag_Init);
+    }
+    else
+    {
+        // PAT/PMT每段开始时重复写入，只需更新continuity_counter
+        m_vecBox.clear();
+        std::vector<uint8_t> vecSection;
+        PutU8(vecSection, 0x00u);  // table_id: program_association_section
+        PutU16(vecSection, 0xB000u | 13u);
+        PutU16(vecSection, 1u);  // transport_stream_id
+        PutU8(vecSection, 0xC1u);
+        PutU16(vecSection, 0u);
+        PutU16(vecSection, 1u);  // program_number
+        PutU16(vecSection, 0xE000u | kPmtPid);
+        PutSection(m_vecBox, 0u, vecSection);
+        vecSection.clear();
+        PutU8(vecSection, 0x02u);  // table_id: TS_program_map_section
+        PutU16(vecSection, 0xB000u | 18u);
+        PutU16(vecSection, 1u);
+        PutU8(vecSection, 0xC1u);
+        PutU16(vecSection, 0u);
+        PutU16(vecSection, 0xE000u | kVideoPid);  // PCR_PID
+        PutU16(vecSection, 0xF000u);
+        PutU8(vecSection, m_bHEVC ? 0x24u : 0x1Bu);
+        PutU16(vecSection, 0xE000u | kVideoPid);
+        PutU16(vecSection, 0xF000u);
+        PutSection(m_vecBox, kPmtPid, vecSection);
+    }
+    LOG_INFO("X2645 muxer opened {} output, timescale {}, reorder delay {}.", m_config.format == X2645Mux_FMP4 ? "fMP4" : "MPEG-TS", m_uTimescale, delay);
+    return true;
+}
+
+void StreamMuxer::BeginFrame(bool key, int64_t index, int64_t tick)
+{
+    if (!m_bOpened)
+    {
+        return;
+    }
+    if (m_uFrames == 0u)
+    {
+        m_nFirstIndex = index;
+        m_nFirstTick = tick;
+    }
+    // 输出顺序即解码顺序，dts按帧间隔递增，pts后移重排延迟后不小于dts
+    const int64_t nPts = (m_config.timescale > 0u ? tick - m_nFirstTick : (index - m_nFirstIndex) * m_nFrameDuration) + m_nDelay;
+    int64_t nDts = m_uFrames > 0u ? m_nLastDts + m_nFrameDuration : 0;
+    // 重排使pts最多领先dts两倍延迟；输入缺帧(采集间隔、准入丢帧)时pts跳变，dts随之前移，避免差值和PCR延迟不断累积
+    if (nPts - nDts > 2 * m_nDelay)
+    {
+        nDts = nPts - 2 * m_nDelay;
+    }
+    nDts = std::min(nDts, nPts);
+    if (m_uFrames > 0u)
+    {
+        nDts = std::max(nDts, m_nLastDts + 1);
+    }
+    const int64_t nSegment = static_cast<int64_t>(m_config.segment_ms) * m_uTimescale / 1000;
+    const bool bCut = key && (m_uFrames == 0u || nDts - m_nSegmentDts >= nSegment);
+    if (m_config.format == X2645Mux_FMP4)
+    {
+        if (!m_vecSamples.empty())
+        {
+            m_vecSamples.back().duration = static_cast<uint32_t>(nDts - m_vecSamples.back().dts);
+            if (bCut || m_szUsed >= m_config.buffer_size)
+            {
+                FlushFragment();
+            }
+        }
+        if (m_vecSamples.empty())
+        {
+            Append(8u);  // mdat头，输出时填写
+        }
+        m_vecSamples.push_back({0u, static_cast<uint32_t>(m_nFrameDuration), nDts, nPts, key});
+    }
+    else
+    {
+        if (bCut || m_szUsed >= m_config.buffer_size)
+        {
+            FlushBuffer();
+        }
+        if (bCut)
+        {
+            WritePsi();
+        }
+        BeginPes(key, nPts, nDts);
+    }
+    if (bCut)
+    {
+        m_bSegmentStart = true;
+        m_nSegmentDts = nDts;
+    }
+    m_nLastDts = nDts;
+    ++m_uFrames;
+}
+
+void StreamMuxer::AddNal(const uint8_t* nal, size_t size)
+{
+    if (!m_bOpened)
+    {
+        return;
+    }
+    if (m_config.format != X2645Mux_FMP4)
+    {
+        AppendPes(nal, size);
+        return;
+    }
+    size_t szSkip = 0ull;
+    while (szSkip < size && nal[szSkip] == 0u)
+    {
+        ++szSkip;
+    }
+    if (szSkip < size && nal[szSkip] == 1u)
+    {
+        ++szSkip;
+    }
+    nal += szSkip;
+    size -= szSkip;
+    if (size == 0ull)
+    {
+        return;
+    }
+    // 参数集在初始化段的avcC/hvcC中，AUD在MP4中不需要
+    const uint32_t uType = m_bHEVC ? ((nal[0] >> 1) & 0x3Fu) : (nal[0] & 0x1Fu);
+    if (m_bHEVC ? (uType >= 32u && uType <= 35u) : (uType >= 7u && uType <= 9u))
+    {
+        return;
+    }
+    uint8_t* pData = Append(4u + size);
+    WriteU32(pData, size);
+    memcpy(pData + 4, nal, size);
+    m_vecSamples.back().size += static_cast<uint32_t>(4u + size);
+}
+
+void StreamMuxer::EndFrame()
+{
+    if (m_bOpened && m_config.format != X2645Mux_FMP4)
+    {
+        FinishPacket();
+    }
+}
+
+void StreamMuxer::Finish()
+{
+    if (!m_bOpened)
+    {
+        return;
+    }
+    if (m_config.format == X2645Mux_FMP4)
+    {
+        if (!m_vecSamples.empty())
+        {
+            FlushFragment();
+        }
+    }
+    else
+    {
+        FinishPacket();
+        FlushBuffer();
+    }
+    m_bOpened = false;
+    LOG_INFO("X2645 muxer finished after {} frames.", m_uFrames);
+}
+
+uint8_t* StreamMuxer::Append(size_t size)
+{
+    uint8_t* pData = m_buffer.Reserve(m_szUsed + size, m_szUsed) + m_szUsed;
+    m_szUsed += size;
+    return pData;
+}
+
+void StreamMuxer::Output(const uint8_t* bytes, size_t size, uint32_t flags)
+{
+    if (m_bSegmentStart)
+    {
+        flags |= X2645MuxFlag_Segment;
+        m_bSegmentStart = false;
+    }
+    if (m_config.out)
+    {
+        m_config.out(bytes, size, flags, m_config.user);
+        return;
+    }
+    while (size > 0ull && !m_bWriteFailed)
+    {
+#ifdef _WIN32
+        const int nWritten = _write(m_config.fd, bytes, static_cast<unsigned int>(std::min<size_t>(size, 1u << 30)));
+#else
+        const ssize_t nWritten = write(m_config.fd, bytes, size);
+#endif
+        if (nWritten < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (nWritten <= 0)
+        {
+            // 写入失败后丢弃之后的数据，避免每帧重复报错
+            LOG_ERROR("X2645 muxer write fd {} failed, errno {}.", m_config.fd, errno);
+            m_bWriteFailed = true;
+            break;
+        }
+        bytes += nWritten;
+        size -= static_cast<size_t>(nWritten);
+    }
+}
+
+void StreamMuxer::WriteInit(const NVIVideoCodecParam& param, const X2645StreamHeaders& headers)
+{
+    std::vector<uint8_t>& out = m_vecBox;
+    out.clear();
+    size_t szBox = BeginBox(out, "ftyp");
+    PutFourCC(out, "iso6");
+    PutU32(out, 0u);
+    PutFourCC(out, "iso6");
+    PutFourCC(out, "cmfc");
+    PutFourCC(out, "mp41");
+    PutFourCC(out, m_bHEVC ? "hvc1" : "avc1");
+    EndBox(out, szBox);
+    const size_t szMoov = BeginBox(out, "moov");
+    szBox = BeginFullBox(out, "mvhd", 0u, 0u);
+    PutU64(out, 0u);  // creation_time, modification_time
+    PutU32(out, m_uTimescale);
+    PutU32(out, 0u);  // duration
+    PutU32(out, 0x00010000u);  // rate
+    PutU16(out, 0x0100u);      // volume
+    out.resize(out.size() + 10u, 0u);
+    for (uint32_t uValue : kUnityMatrix)
+    {
+        PutU32(out, uValue);
+    }
+    out.resize(out.size() + 24u, 0u);
+    PutU32(out, 2u);  // next_track_ID
+    EndBox(out, szBox);
+    const size_t szTrak = BeginBox(out, "trak");
+    szBox = BeginFullBox(out, "tkhd", 0u, 3u);  // track_enabled | track_in_movie
+    PutU64(out, 0u);
+    PutU32(out, 1u);  // track_ID
+    PutU32(out, 0u);
+    PutU32(out, 0u);  // duration
+    out.resize(out.size() + 16u, 0u);  // reserved, layer, alternate_group, volume, reserved
+    for (uint32_t uValue : kUnityMatrix)
+    {
+        PutU32(out, uValue);
+    }
+    PutU32(out, param.width << 16);
+    PutU32(out, param.height << 16);
+    EndBox(out, szBox);
+    const size_t szMdia = BeginBox(out, "mdia");
+    szBox = BeginFullBox(out, "mdhd", 0u, 0u);
+    PutU64(out, 0u);
+    PutU32(out, m_uTimescale);
+    PutU32(out, 0u);
+    PutU16(out, 0x55C4u);  // und
+    PutU16(out, 0u);
+    EndBox(out, szBox);
+    szBox = BeginFullBox(out, "hdlr", 0u, 0u);
+    PutU32(out, 0u);
+    PutFourCC(out, "vide");
+    out.resize(out.size() + 12u, 0u);
+    static const char kHandlerName[] = "VideoHandler";
+    out.insert(out.end(), kHandlerName, kHandlerName + sizeof(kHandlerName));
+    EndBox(out, szBox);
+    const size_t szMinf = BeginBox(out, "minf");
+    szBox = BeginFullBox(out, "vmhd", 0u, 1u);
+    out.resize(out.size() + 8u, 0u);
+    EndBox(out, szBox);
+    const size_t szDinf = BeginBox(out, "dinf");
+    szBox = BeginFullBox(out, "dref", 0u, 0u);
+    PutU32(out, 1u);
+    EndBox(out, BeginFullBox(out, "url ", 0u, 1u));  // 数据在同一文件中
+    EndBox(out, szBox);
+    EndBox(out, szDinf);
+    const size_t szStbl = BeginBox(out, "stbl");
+    const size_t szStsd = BeginFullBox(out, "stsd", 0u, 0u);
+    PutU32(out, 1u);
+    const size_t szEntry = BeginBox(out, m_bHEVC ? "hvc1" : "avc1");
+    out.resize(out.size() + 6u, 0u);
+    PutU16(out, 1u);  // data_reference_index
+    out.resize(out.size() + 16u, 0u);
+    PutU16(out, param.width);
+    PutU16(out, param.height);
+    PutU32(out, 0x00480000u);  // 72dpi
+    PutU32(out, 0x00480000u);
+    PutU32(out, 0u);
+    PutU16(out, 1u);  // frame_count
+    out.resize(out.size() + 32u, 0u);  // compressorname
+    PutU16(out, 0x0018u);
+    PutU16(out, 0xFFFFu);
+    szBox = BeginBox(out, m_bHEVC ? "hvcC" : "avcC");
+    out.insert(out.end(), headers.record, headers.record + headers.record_size);
+    EndBox(out, szBox);
+    EndBox(out, szEntry);
+    EndBox(out, szStsd);
+    // 样本都在分片中，样本表为空
+    szBox = BeginFullBox(out, "stts", 0u, 0u);
+    PutU32(out, 0u);
+    EndBox(out, szBox);
+    szBox = BeginFullBox(out, "stsc", 0u, 0u);
+    PutU32(out, 0u);
+    EndBox(out, szBox);
+    szBox = BeginFullBox(out, "stsz", 0u, 0u);
+    PutU64(out, 0u);
+    EndBox(out, szBox);
+    szBox = BeginFullBox(out, "stco", 0u, 0u);
+    PutU32(out, 0u);
+    EndBox(out, szBox);
+    EndBox(out, szStbl);
+    EndBox(out, szMinf);
+    EndBox(out, szMdia);
+    EndBox(out, szTrak);
+    const size_t szMvex = BeginBox(out, "mvex");
+    szBox = BeginFullBox(out, "trex", 0u, 0u);
+    PutU32(out, 1u);  // track_ID
+    PutU32(out, 1u);  // default_sample_description_index
+    out.resize(out.size() + 12u, 0u);
+    EndBox(out, szBox);
+    EndBox(out, szMvex);
+    EndBox(out, szMoov);
+}
+
+void StreamMuxer::FlushFragment()
+{
+    std::vector<uint8_t>& out = m_vecBox;
+    out.clear();
+    const size_t szMoof = BeginBox(out, "moof");
+    size_t szBox = BeginFullBox(out, "mfhd", 0u, 0u);
+    PutU32(out, ++m_uSequence);
+    EndBox(out, szBox);
+    const size_t szTraf = BeginBox(out, "traf");
+    szBox = BeginFullBox(out, "tfhd", 0u, 0x020000u);  // default-base-is-moof
+    PutU32(out, 1u);
+    EndBox(out, szBox);
+    szBox = BeginFullBox(out, "tfdt", 1u, 0u);
+    PutU64(out, static_cast<uint64_t>(m_vecSamples.front().dts));
+    EndBox(out, szBox);
+    // data_offset, sample_duration, sample_size, sample_flags, sample_composition_time_offset(有符号)
+    szBox = BeginFullBox(out, "trun", 1u, 0x000F01u);
+    PutU32(out, static_cast<uint32_t>(m_vecSamples.size()));
+    const size_t szDataOffset = out.size();
+    PutU32(out, 0u);
+    for (const Sample& sample : m_vecSamples)
+    {
+        PutU32(out, sample.duration);
+        PutU32(out, sample.size);
+        PutU32(out, sample.key ? kKeySampleFlags : kDeltaSampleFlags);
+        PutU32(out, static_cast<uint32_t>(sample.pts - sample.dts));
+    }
+    EndBox(out, szBox);
+    EndBox(out, szTraf);
+    EndBox(out, szMoof);
+    WriteU32(out.data() + szDataOffset, out.size() + 8u);
+    uint8_t* pData = m_buffer.Data();
+    WriteU32(pData, m_szUsed);
+    memcpy(pData + 4, "mdat", 4);
+    Output(out.data(), out.size(), 0u);
+    Output(pData, m_szUsed, 0u);
+    m_buffer.Commit(m_szUsed);
+    m_szUsed = 0ull;
+    m_vecSamples.clear();
+}
+
+void StreamMuxer::WritePsi()
+{
+    uint8_t* pData = Append(m_vecBox.size());
+    memcpy(pData, m_vecBox.data(), m_vecBox.size());
+    const uint8_t uCounter = static_cast<uint8_t>(m_uPsiCounter++ & 0x0Fu);
+    pData[3] |= uCounter;
+    pData[kTsPacket + 3] |= uCounter;
+}
+
+void StreamMuxer::BeginPes(bool key, int64_t pts, int64_t dts)
+{
+    // 转换为33位的90kHz时间戳
+    const uint64_t uScale = m_uTimescale;
+    const uint64_t uPts = static_cast<uint64_t>(pts) / uScale * 90000u + static_cast<uint64_t>(pts) % uScale * 90000u / uScale + kTsBaseTime;
+    const uint64_t uDts = static_cast<uint64_t>(dts) / uScale * 90000u + static_cast<uint64_t>(dts) % uScale * 90000u / uScale + kTsBaseTime;
+    const uint64_t uPcr = uDts - kPcrLead;
+    // 第一个包带PCR，关键帧设置random_access_indicator
+    m_szPacket = m_szUsed;
+    uint8_t* pPacket = Append(kTsPacket);
+    pPacket[0] = 0x47u;
+    pPacket[1] = static_cast<uint8_t>(0x40u | (kVideoPid >> 8));
+    pPacket[2] = static_cast<uint8_t>(kVideoPid & 0xFFu);
+    pPacket[3] = static_cast<uint8_t>(0x30u | (m_uVideoCounter++ & 0x0Fu));
+    pPacket[4] = 7u;
+    pPacket[5] = static_cast<uint8_t>(0x10u | (key ? 0x40u : 0u));
+    pPacket[6] = static_cast<uint8_t>(uPcr >> 25);
+    pPacket[7] = static_cast<uint8_t>(uPcr >> 17);
+    pPacket[8] = static_cast<uint8_t>(uPcr >> 9);
+    pPacket[9] = static_cast<uint8_t>(uPcr >> 1);
+    pPacket[10] = static_cast<uint8_t>(((uPcr & 1u) << 7) | 0x7Eu);
+    pPacket[11] = 0u;
+    m_szPacketFill = 12u;
+    uint8_t header[19] = {0u, 0u, 1u, 0xE0u, 0u, 0u, 0x80u};  // 视频PES长度为0，不限制
+    const bool bDts = uDts != uPts;
+    header[7] = bDts ? 0xC0u : 0x80u;
+    header[8] = bDts ? 10u : 5u;
+    WriteTimestamp(header + 9, bDts ? 3u : 2u, uPts & 0x1FFFFFFFFull);
+    if (bDts)
+    {
+        WriteTimestamp(header + 14, 1u, uDts & 0x1FFFFFFFFull);
+    }
+    AppendPes(header, bDts ? 19u : 14u);
+    if (m_bHEVC)
+    {
+        AppendPes(kHevcAUD, sizeof(kHevcAUD));
+    }
+    else
+    {
+        AppendPes(kAvcAUD, sizeof(kAvcAUD));
+    }
+    if (key && !m_bInband)
+    {
+        AppendPes(m_vecHeaders.data(), m_vecHeaders.size());
+    }
+}
+
+void StreamMuxer::AppendPes(const uint8_t* data, size_t size)
+{
+    while (size > 0ull)
+    {
+        if (m_szPacketFill == 0ull)
+        {
+            m_szPacket = m_szUsed;
+            uint8_t* pPacket = Append(kTsPacket);
+            pPacket[0] = 0x47u;
+            pPacket[1] = static_cast<uint8_t>(kVideoPid >> 8);
+            pPacket[2] = static_cast<uint8_t>(kVideoPid & 0xFFu);
+            pPacket[3] = static_cast<uint8_t>(0x10u | (m_uVideoCounter++ & 0x0Fu));
+            m_szPacketFill = 4u;
+        }
+        const size_t szCopy = std::min(size, kTsPacket - m_szPacketFill);
+        memcpy(m_buffer.Data() + m_szPacket + m_szPacketFill, data, szCopy);
+        m_szPacketFill = m_szPacketFill + szCopy == kTsPacket ? 0ull : m_szPacketFill + szCopy;
+        data += szCopy;
+        size -= szCopy;
+    }
+}
+
+void StreamMuxer::FinishPacket()
+{
+    if (m_szPacketFill == 0ull)
+    {
+        return;
+    }
+    // PES的最后一个包用适配域填充到188字节
+    uint8_t* pPacket = m_buffer.Data() + m_szPacket;
+    const size_t szStuffing = kTsPacket - m_szPacketFill;
+    const bool bAdaptation = (pPacket[3] & 0x20u) != 0u;
+    const size_t szPayload = bAdaptation ? 5u + pPacket[4] : 4u;
+    memmove(pPacket + szPayload + szStuffing, pPacket + szPayload, m_szPacketFill - szPayload);
+    if (bAdaptation)
+    {
+        memset(pPacket + szPayload, 0xFF, szStuffing);
+        pPacket[4] = static_cast<uint8_t>(pPacket[4] + szStuffing);
+    }
+    else
+    {
+        pPacket[3] |= 0x20u;
+        pPacket[4] = static_cast<uint8_t>(szStuffing - 1u);
+        if (szStuffing > 1u)
+        {
+            pPacket[5] = 0u;
+            memset(pPacket + 6, 0xFF, szStuffing - 2u);
+        }
+    }
+    m_szPacketFill = 0ull;
+}
+
+void StreamMuxer::FlushBuffer()
+{
+    if (m_szUsed == 0ull)
+    {
+        return;
+    }
+    Output(m_buffer.Data(), m_szUsed, 0u);
+    m_buffer.Commit(m_szUsed);
+    m_szUsed = 0ull;
+}
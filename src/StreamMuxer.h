@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Codec.h"
+#include "StreamBuffer.h"
+
+/*
+ * 封装输出：编码器按帧调用`BeginFrame`/`AddNal`/`EndFrame`，NAL直接写入对齐的输出缓存。
+ * fMP4的NAL起始码换成4字节长度，参数集放在初始化段中；一个分片缓存到切段或缓存写满时输出moof+mdat。
+ * MPEG-TS每帧一个PES，逐个188字节的包写入缓存，切段或缓存写满时输出。
+ * 输出时间轴以第一帧为0并整体后移重排延迟，保证dts不为负且不大于pts。
+ */
+class StreamMuxer final
+{
+public:
+    ~StreamMuxer();
+
+public:
+    // format为None时关闭，已打开的流先结束
+    void Config(const X2645MuxConfig* config);
+    bool Configured() const { return m_config.format != X2645Mux_None; }
+    bool Opened() const { return m_bOpened; }
+    // delay为B帧重排的帧数，inband为关键帧自带参数集
+    bool Open(const NVIVideoCodecParam& param, uint32_t delay, bool inband, const X2645StreamHeaders& headers);
+    // index为输入帧序号(显示顺序)，tick为输入帧的`info.tick`
+    void BeginFrame(bool key, int64_t index, int64_t tick);
+    // Annex-B NAL(含起始码)
+    void AddNal(const uint8_t* nal, size_t size);
+    void EndFrame();
+    // 输出剩余数据并结束当前流，配置保留
+    void Finish();
+
+private:
+    struct Sample
+    {
+        uint32_t size;
+        uint32_t duration;
+        int64_t dts;
+        int64_t pts;
+        bool key;
+    };
+
+    uint8_t* Append(size_t size);
+    void Output(const uint8_t* bytes, size_t size, uint32_t flags);
+    void WriteInit(const NVIVideoCodecParam& param, const X2645StreamHeaders& headers);
+    void FlushFragment();
+    void WritePsi();
+    void BeginPes(bool key, int64_t pts, int64_t dts);
+    void AppendPes(const uint8_t* data, size_t size);
+    void FinishPacket();
+    void FlushBuffer();
+
+private:
+    static constexpr size_t kDefaultBufferSize = 4u << 20;
+
+    X2645MuxConfig m_config{};
+    bool m_bOpened = false;
+    bool m_bHEVC = false;
+    bool m_bInband = true;
+    uint32_t m_uTimescale = 0u;
+    int64_t m_nFrameDuration = 0;
+    int64_t m_nDelay = 0;  // 时间轴后移量
+    int64_t m_nFirstIndex = 0;
+    int64_t m_nFirstTick = 0;
+    int64_t m_nLastDts = 0;
+    int64_t m_nSegmentDts = 0;
+    uint64_t m_uFrames = 0u;
+    uint32_t m_uSequence = 0u;
+    bool m_bFrameKey = false;
+    bool m_bSegmentStart = false;
+    bool m_bWriteFailed = false;
+    StreamBuffer m_buffer;
+    size_t m_szUsed = 0ull;
+    std::vector<uint8_t> m_vecBox;  // 初始化段、moof，MPEG-TS为PAT/PMT
+    std::vector<uint8_t> m_vecHeaders;  // Annex-B参数集
+    std::vector<Sample> m_vecSamples;
+    size_t m_szPacket = 0ull;  // MPEG-TS当前包在缓存中的位置
+    size_t m_szPacketFill = 0ull;  // 当前包已写入的字节数，0表示没有未完成的包
+    uint8_t m_uVideoCounter = 0u;
+    uint8_t m_uPsiCounter = 0u;
+};
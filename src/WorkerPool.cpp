@@ -0,0 +1,170 @@
+﻿#include "WorkerPool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "adaption/Logging.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef __linux__
+static_assert(sizeof(cpu_set_t) <= 128, "cpu_set_t is larger than the saved mask.");
+
+// 解析/sys/devices/system/node/nodeN/cpulist，格式如"0-15,32-47"
+static bool NodeCpuSet(int32_t node, cpu_set_t& set)
+{
+    char szPath[64];
+    snprintf(szPath, sizeof(szPath), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE* pFile = fopen(szPath, "r");
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+    CPU_ZERO(&set);
+    int nFirst = 0;
+    while (fscanf(pFile, "%d", &nFirst) == 1)
+    {
+        int nLast = nFirst;
+        int nSep = fgetc(pFile);
+        if (nSep == '-')
+        {
+            if (fscanf(pFile, "%d", &nLast) != 1)
+            {
+                break;
+            }
+            nSep = fgetc(pFile);
+        }
+        for (int i = nFirst; i <= nLast && i < CPU_SETSIZE; ++i)
+        {
+            CPU_SET(i, &set);
+        }
+        if (nSep != ',')
+        {
+            break;
+        }
+    }
+    fclose(pFile);
+    return CPU_COUNT(&set) > 0;
+}
+#endif
+
+WorkerPool& WorkerPool::Instance()
+{
+    static WorkerPool s_pool;
+    return s_pool;
+}
+
+void WorkerPool::Configure(const X2645WorkerPoolConfig& config)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_config = config;
+    m_uWorkers = config.workers > 0u ? config.workers : std::max(std::thread::hardware_concurrency(), 1u);
+    LOG_NOTICE("X2645 worker pool: {} workers, affinity 0x{:x}, numa node {}.", m_uWorkers, config.affinity_mask, config.numa_node);
+}
+
+uint32_t WorkerPool::Acquire(uint32_t desired)
+{
+    desired = std::max(desired, 1u);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t uGranted = desired;
+    if (m_uWorkers > 0u)
+    {
+        // 池已用尽时仍给1个线程(即在调用线程中编码)，保证每个实例都能工作
+        uGranted = m_uUsed < m_uWorkers ? std::min(desired, m_uWorkers - m_uUsed) : 1u;
+    }
+    m_uUsed += uGranted;
+    return uGranted;
+}
+
+void WorkerPool::Release(uint32_t threads)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_uUsed -= std::min(threads, m_uUsed);
+}
+
+void WorkerPool::Usage(uint32_t threads, X2645PoolUsage& usage)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    usage.threads = threads;
+    usage.used = m_uUsed;
+    usage.workers = m_uWorkers;
+}
+
+std::string WorkerPool::NumaPools(uint32_t threads)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // x265 --pools格式：按NUMA节点逗号分隔的线程数，'-'表示该节点不创建线程
+    std::string strPools;
+    for (int32_t i = 0; i < m_config.numa_node; ++i)
+    {
+        strPools += "-,";
+    }
+    strPools += std::to_string(threads);
+    return strPools;
+}
+
+//////////////////////////////////////////////////////////////////////////
+WorkerPool::Placement::Placement()
+    : m_bApplied(false)
+    , m_savedMask{}
+{
+#ifdef __linux__
+    WorkerPool& pool = WorkerPool::Instance();
+    X2645WorkerPoolConfig config{};
+    {
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        config = pool.m_config;
+    }
+    if (config.affinity_mask == 0ull && config.numa_node < 0)
+    {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (config.numa_node < 0 || !NodeCpuSet(config.numa_node, set))
+    {
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+        {
+            CPU_SET(i, &set);
+        }
+    }
+    if (config.affinity_mask != 0ull)
+    {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        for (int i = 0; i < 64; ++i)
+        {
+            if (config.affinity_mask & (1ull << i))
+            {
+                CPU_SET(i, &mask);
+            }
+        }
+        CPU_AND(&set, &set, &mask);
+    }
+    cpu_set_t saved;
+    if (CPU_COUNT(&set) == 0 || pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) != 0)
+    {
+        LOG_WARNING("X2645 worker pool placement ignored, no usable cpu.");
+        return;
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+    {
+        memcpy(m_savedMask, &saved, sizeof(saved));
+        m_bApplied = true;
+    }
+#endif
+}
+
+WorkerPool::Placement::~Placement()
+{
+#ifdef __linux__
+    if (m_bApplied)
+    {
+        cpu_set_t saved;
+        memcpy(&saved, m_savedMask, sizeof(saved));
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    }
+#endif
+}
@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "Codec.h"
+
+/*
+ * 进程级的编码线程池配置。
+ * libx264/libx265不支持外部线程池，这里以线程预算的方式在所有编码实例间分配线程：
+ * 每个实例在`Config`时按分辨率申请线程，池中剩余不足时降级，`Release`时归还。
+ * 编码器内部线程在打开时创建，打开期间将调用线程绑定到配置的CPU/NUMA节点，新线程继承该亲和性。
+ */
+class WorkerPool final
+{
+public:
+    static WorkerPool& Instance();
+
+public:
+    void Configure(const X2645WorkerPoolConfig& config);
+    uint32_t Acquire(uint32_t desired);
+    void Release(uint32_t threads);
+    void Usage(uint32_t threads, X2645PoolUsage& usage);
+    std::string NumaPools(uint32_t threads);
+
+public:
+    // 作用域内将当前线程绑定到线程池的CPU集合
+    class Placement final
+    {
+    public:
+        Placement();
+        ~Placement();
+        Placement(const Placement&) = delete;
+        Placement& operator=(const Placement&) = delete;
+
+    private:
+        bool m_bApplied;
+        uint8_t m_savedMask[128];
+    };
+
+private:
+    WorkerPool() = default;
+
+private:
+    std::mutex m_mutex;
+    X2645WorkerPoolConfig m_config{0u, 0ull, -1};  // 未调用`Configure`时不绑定NUMA节点
+    uint32_t m_uWorkers = 0u;  // 0表示未配置，不限制线程数
+    uint32_t m_uUsed = 0u;
+};
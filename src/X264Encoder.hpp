@@ -1,18 +1,40 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <cmath>
 #include <memory>
+#include <thread>
 #include <vector>
 #include <NVI/Codec.h>
 #include <x264.h>
+#include "AdmissionControl.h"
+#include "Codec.h"
+#include "EncoderPool.h"
+#include "FrameStats.h"
+#include "ParameterSets.h"
+#include "PixelConvert.h"
+#include "QuantMap.h"
+#include "RtpPacketizer.h"
+#include "SliceDelivery.h"
+#include "SpeedGovernor.h"
+#include "StreamBuffer.h"
+#include "StreamMuxer.h"
+#include "WorkerPool.h"
+#include "adaption/Clock.h"
 #include "adaption/Logging.h"
+#include "adaption/Trace.h"
+
+struct EncodeContext;
 
 class X264Encoder final
 {
 private:
     static void NaluProcess(x264_t* h, x264_nal_t* nal, void* opaque);
+    static void SliceOutput(EncodeContext& context, NVIVideoEncodedPacket& packet, bool last);
     static void Logging(void*, int level, const char* fmt, va_list vars);
+    static void ClosePooled(EncoderPoolEntry& entry);
 
 public:
     X264Encoder();
@@ -21,42 +43,136 @@ public:
 public:
     int32_t Config(const NVIVideoCodecParam& param);
     int32_t Encoding(const NVIVideoImageFrame& in, NVIVideoEncode::OnPacket out, void* user);
+    int32_t Flush(NVIVideoEncode::OnPacket out, void* user);
+    int32_t Reconfig(const NVIVideoCodecParam& param, uint32_t fields, uint32_t& rejected);
+    int32_t IntraRefresh();
     void Release();
+    void SetOptions(const X2645EncodeOptions& options);
+    void SetSegmentOutput(X2645OnSegments out);
+    bool HasSegmentOutput() const { return m_pSegmentOutput != nullptr; }
+    void SetRtpOutput(const X2645RtpConfig& config);
+    int32_t SetRoi(const X2645RoiRegion* regions, uint32_t count);
+    int32_t SetSpeedGovernor(const X2645SpeedGovernorConfig* config);
+    void SetAdmission(const X2645AdmissionConfig* config);
+    void GetAdmissionStats(X2645AdmissionStats& stats) const { m_admission.Stats(stats); }
+    int32_t SetMuxOutput(const X2645MuxConfig* config);
+    void GetBufferStats(X2645BufferStats& stats) const;
+    bool GetFrameStats(X2645FrameStats& stats) const { return m_frameStats.Query(stats); }
+    bool GetHeaders(X2645StreamHeaders& headers) const { return m_pHandle && m_headers.Query(headers); }
+    bool GetSliceDeliveryStats(X2645SliceDeliveryStats& stats) const { return m_delivery.Stats(stats); }
+    uint32_t Threads() const { return m_uThreads; }
+    const NVIVideoCodecParam& Param() const { return m_param; }
 
 private:
+    int32_t Reuse(const NVIVideoCodecParam& param, EncoderPoolEntry& entry);
+    int32_t EncodeFrame(x264_picture_t* pic, NVIVideoEncode::OnPacket out, void* user);
     bool PicturePalneCopy(const NVIVideoImageFrame& in, x264_picture_t& out);
+    void BuildHeaders();
+    bool OpenMuxer();
+    void StartDelivery();
+    bool ApplySpeedLevel(uint32_t level);
+    void GovernSpeed(int64_t begin);
 
 private:
+    using FrameInfo = decltype(NVIVideoImageFrame::info);
+
     x264_t* m_pHandle;
+    NVIVideoCodecParam m_param;
+    X2645EncodeOptions m_options;
+    X2645EncodeOptions m_activeOptions;  // 当前打开的编码器使用的选项
     x264_picture_t m_picture;
-    std::vector<std::unique_ptr<uint8_t[]>> m_vecStreamBuffer;
+    PixelConverter m_converter;
+    FrameStatsRecorder m_frameStats;
+    ParameterSets m_headers;
+    QuantMap m_quantMap;
+    SpeedGovernor m_governor;
+    AdmissionControl m_admission;
+    StreamMuxer m_muxer;
+    SliceDelivery m_delivery;
+    std::vector<StreamBuffer> m_vecStreamBuffer;
+    std::vector<X2645NalSegment> m_vecSegments;
+    std::vector<FrameInfo> m_vecFrameInfo;
+    X2645OnSegments m_pSegmentOutput;
+    X2645RtpConfig m_rtp;
+    std::vector<RtpPacketizer> m_vecRtp;  // 每个slice一个，slice可能在不同线程中打包
+    int64_t m_nFrameIndex;
     uint16_t m_uSliceMode;
-    uint16_t m_uSliceCount;
-    uint32_t m_uMBsPerSlice;
+    uint16_t m_uSliceCount;  // MaxBytes模式下为0，slice数逐帧变化
+    std::vector<uint32_t> m_vecSliceRows;
+    uint32_t m_uThreads;
+    uint32_t m_uWidth;
+    uint32_t m_uHeight;
+    bool m_bFlushed;
+    std::atomic<bool> m_bForceIntra;    // 可在其他线程请求
+    std::atomic<bool> m_bIntraRefresh;  // 可在其他线程请求，在下一次编码前开始帧内刷新
 
-    const size_t kBufferSize = 1 * 1024 * 1024;
     const uint32_t kMaxFrameSize = 4096 * 2048;
     const uint32_t kMaxFrameRate = 60;
     const uint32_t kSliceLines = 272;
+    const int kThroughputBFrames = 3;
+    const int kThroughputLookahead = 20;
+    const float kQuantMapAqStrength = 0.05f;
 };
 
 //////////////////////////////////////////////////////////////////////////
 struct EncodeContext
 {
     const NVIVideoEncodedPacket& packet;
-    const std::vector<std::unique_ptr<uint8_t[]>>& buffers;
+    std::vector<StreamBuffer>& buffers;
     size_t szExtraOffset = 0ull;  // sps pps data
     NVIVideoEncode::OnPacket pOutput = nullptr;
     void* pUser = nullptr;
-    uint32_t uMBsPerSlice = 0u;
-    uint32_t uSliceNumber = 0u;
-    EncodeContext(NVIVideoEncodedPacket& pkt, const std::vector<std::unique_ptr<uint8_t[]>>& buf)
+    const std::vector<uint32_t>* pSliceRows = nullptr;  // 为空时slice按输出顺序编号
+    uint32_t uMBWidth = 0u;
+    std::atomic<uint32_t> uSliceNumber{0u};  // 已输出的slice数，sliced threads下由多个线程累加
+    NVIVideoEncodedPacket pending{};  // 按顺序编号时延迟一个slice输出，以便在最后一个slice填写slice_count
+    const X2645RtpConfig* pRtp = nullptr;
+    std::vector<RtpPacketizer>* pPacketizers = nullptr;
+    FrameStatsRecorder* pStats = nullptr;
+    SliceDelivery* pDelivery = nullptr;  // 不为空时slice交给交付线程回调
+    uint64_t uFrame = 0u;
+    // 每个slice的NAL(不含合并的参数集)在缓存中的位置，由编码该slice的线程写入，供封装使用
+    const uint8_t* pSliceNal[X2645_MAX_SLICES] = {};
+    size_t szSliceNal[X2645_MAX_SLICES] = {};
+    EncodeContext(NVIVideoEncodedPacket& pkt, std::vector<StreamBuffer>& buf)
         : packet(pkt)
         , buffers(buf)
     {
     }
 };
 
+// 按slice布局计算slice数，MaxBytes模式返回0
+inline uint32_t X264SliceCount(const X2645EncodeOptions& options, uint32_t height, uint32_t lines)
+{
+    const uint32_t uRows = (height + 15) >> 4;
+    uint32_t uSlices = (height + lines - 1) / lines;
+    switch (options.slice_layout)
+    {
+    case X2645SliceLayout_Rows: uSlices = (uRows + options.slice_value - 1) / options.slice_value; break;
+    case X2645SliceLayout_Count: uSlices = options.slice_value; break;
+    case X2645SliceLayout_MaxBytes: return 0u;
+    default: break;
+    }
+    return std::max(std::min({uSlices, uRows, static_cast<uint32_t>(X2645_MAX_SLICES)}), 1u);
+}
+
+// sliced threads下每个线程的起始宏块行，与x264 threaded_slices_write()的划分一致
+inline void X264SliceRows(uint32_t height, uint32_t threads, std::vector<uint32_t>& rows)
+{
+    const uint32_t uRows = (height + 15) >> 4;
+    rows.resize(threads);
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        rows[i] = (uRows * i + threads / 2) / threads;
+    }
+}
+
+// x264_nal_encode()要求的输出缓存大小
+inline size_t NalEncodeSize(const x264_nal_t* nal)
+{
+    return static_cast<size_t>(nal->i_payload) * 3 / 2 + 5 + 64;
+}
+
 int ToX264CSP(NVIPixelFormat format)
 {
     switch (format)
@@ -65,20 +181,69 @@ int ToX264CSP(NVIPixelFormat format)
     case NVIPixel_NV12: return X264_CSP_NV12;
     case NVIPixel_NV21: return X264_CSP_NV21;
     case NVIPixel_422P: return X264_CSP_I422;
-    case NVIPixel_V210: return X264_CSP_V210;
+    case NVIPixel_V210: return X264_CSP_I422;
+    case NVIPixel_UYVY: return X264_CSP_I422;
+    case NVIPixel_YUY2: return X264_CSP_I422;
     default: return 0;
     }
 }
 
+static uint32_t X264FrameType(int type)
+{
+    switch (type)
+    {
+    case X264_TYPE_IDR: return X2645FrameType_IDR;
+    case X264_TYPE_I: return X2645FrameType_I;
+    case X264_TYPE_P: return X2645FrameType_P;
+    case X264_TYPE_BREF:
+    case X264_TYPE_B: return X2645FrameType_B;
+    default: return X2645FrameType_Unknown;
+    }
+}
+
+// 8bit libx264不支持V210，打包格式统一转换为I422
+static NVIPixelFormat X264NativeFormat(NVIPixelFormat format)
+{
+    switch (format)
+    {
+    case NVIPixel_V210:
+    case NVIPixel_UYVY:
+    case NVIPixel_YUY2: return NVIPixel_422P;
+    default: return format;
+    }
+}
+
+/*
+ * 速度级别对应的分析参数，均可通过x264_encoder_reconfig修改；默认级别与`Config`中的设置一致。
+ * `Config`以ultrafast预设打开(subme 0)，x264_encoder_reconfig不能从subme 0切换出来，subme保持预设值。
+ */
+struct X264SpeedLevel
+{
+    int me;
+    int range;
+    unsigned int partitions;  // 同时用于analyse.intra和analyse.inter(只取帧内部分)
+    int fastPSkip;
+    int chromaME;
+};
+
+static const X264SpeedLevel kX264SpeedLevels[X2645_SPEED_LEVELS] = {
+    {X264_ME_DIA, 4, 0u, 1, 0},
+    {X264_ME_DIA, 4, 0u, 0, 1},
+    {X264_ME_HEX, 8, X264_ANALYSE_I4x4 | X264_ANALYSE_PSUB16x16, 0, 1},
+    {X264_ME_HEX, 16, X264_ANALYSE_I4x4 | X264_ANALYSE_PSUB16x16, 0, 1},
+    {X264_ME_UMH, 16, X264_ANALYSE_I4x4 | X264_ANALYSE_PSUB16x16 | X264_ANALYSE_BSUB16x16, 0, 1},
+};
+
 inline void X264Encoder::NaluProcess(x264_t* h, x264_nal_t* nal, void* opaque)
 {
     if (opaque && nal)
     {
         EncodeContext* pContext = reinterpret_cast<EncodeContext*>(opaque);
-        if (pContext->uMBsPerSlice == 0u && nal->i_payload > 0)
+        if (pContext->uMBWidth == 0u && nal->i_payload > 0)
         {
             return;
         }
+        TRACE_SCOPE("slice", nal->i_first_mb);
         if (nal->i_type == NAL_SEI || nal->i_type == NAL_SPS || nal->i_type == NAL_PPS)
         {
             /*
@@ -87,41 +252,114 @@ inline void X264Encoder::NaluProcess(x264_t* h, x264_nal_t* nal, void* opaque)
              */
             if (!pContext->buffers.empty())
             {
-                x264_nal_encode(h, pContext->buffers[0].get() + pContext->szExtraOffset, nal);
+                StreamBuffer& buffer = pContext->buffers[0];
+                uint8_t* pData = buffer.Reserve(pContext->szExtraOffset + NalEncodeSize(nal), pContext->szExtraOffset);
+                x264_nal_encode(h, pData + pContext->szExtraOffset, nal);
                 pContext->szExtraOffset += static_cast<size_t>(nal->i_payload);
+                if (pContext->pRtp)
+                {
+                    pContext->pPacketizers->front().Add(nal->p_payload, static_cast<size_t>(nal->i_payload));
+                }
             }
         }
         else
         {
-            const size_t szOffset = static_cast<size_t>(std::ceil(nal->i_first_mb / static_cast<float>(pContext->uMBsPerSlice)));
+            size_t szOffset = pContext->uSliceNumber.load(std::memory_order_relaxed);
+            if (pContext->pSliceRows)
+            {
+                const std::vector<uint32_t>& rows = *pContext->pSliceRows;
+                const uint32_t uRow = static_cast<uint32_t>(nal->i_first_mb) / pContext->uMBWidth;
+                szOffset = static_cast<size_t>(std::upper_bound(rows.begin(), rows.end(), uRow) - rows.begin()) - 1u;
+            }
+            else if (szOffset >= pContext->buffers.size())
+            {
+                pContext->buffers.resize(szOffset + 1u);  // 单线程编码，已输出slice的数据不会移动
+            }
+            if (pContext->pRtp && szOffset >= pContext->pPacketizers->size())
+            {
+                pContext->pPacketizers->resize(szOffset + 1u);
+                pContext->pPacketizers->back().Config(NVICodec_AVC, pContext->pRtp->mtu);
+            }
             if (szOffset < pContext->buffers.size())
             {
                 NVIVideoEncodedPacket packet = pContext->packet;
+                StreamBuffer& buffer = pContext->buffers[szOffset];
                 if (szOffset == 0 && pContext->szExtraOffset > 0ull)
                 {
-                    x264_nal_encode(h, pContext->buffers[szOffset].get() + pContext->szExtraOffset, nal);
-                    packet.buffer.bytes = pContext->buffers[szOffset].get();
+                    TRACE_SCOPE("copy", pContext->szExtraOffset + nal->i_payload);
+                    uint8_t* pData = buffer.Reserve(pContext->szExtraOffset + NalEncodeSize(nal), pContext->szExtraOffset);
+                    x264_nal_encode(h, pData + pContext->szExtraOffset, nal);
+                    packet.buffer.bytes = pData;
                     packet.buffer.size = pContext->szExtraOffset + nal->i_payload;
                 }
                 else
                 {
-                    x264_nal_encode(h, pContext->buffers[szOffset].get(), nal);
+                    TRACE_SCOPE("copy", nal->i_payload);
+                    x264_nal_encode(h, buffer.Reserve(NalEncodeSize(nal)), nal);
                     packet.buffer.bytes = nal->p_payload;
                     packet.buffer.size = nal->i_payload;
                 }
+                buffer.Commit(packet.buffer.size);
+                if (szOffset < X2645_MAX_SLICES)
+                {
+                    pContext->pSliceNal[szOffset] = packet.buffer.bytes + packet.buffer.size - nal->i_payload;
+                    pContext->szSliceNal[szOffset] = static_cast<size_t>(nal->i_payload);
+                }
+                if (pContext->pRtp)
+                {
+                    (*pContext->pPacketizers)[szOffset].Add(nal->p_payload, static_cast<size_t>(nal->i_payload));
+                }
+                if (pContext->pStats)
+                {
+                    pContext->pStats->OnSlice(static_cast<uint32_t>(szOffset), packet.buffer.size);
+                }
                 packet.info.frame_kind = nal->i_type == NAL_SLICE_IDR ? NVIFrameKind_Intra : NVIFrameKind_Delta;
                 packet.slice_offset = static_cast<uint16_t>(szOffset);
                 packet.slice_number = 1;
-                pContext->pOutput(&packet, pContext->pUser);
-                ++pContext->uSliceNumber;
+                if (pContext->pSliceRows)
+                {
+                    SliceOutput(*pContext, packet, szOffset + 1u == packet.slice_count);
+                }
+                else
+                {
+                    if (pContext->uSliceNumber > 0u)
+                    {
+                        SliceOutput(*pContext, pContext->pending, false);
+                    }
+                    pContext->pending = packet;
+                }
+                pContext->uSliceNumber.fetch_add(1u, std::memory_order_relaxed);
             }
         }
     }
 }
 
+inline void X264Encoder::SliceOutput(EncodeContext& context, NVIVideoEncodedPacket& packet, bool last)
+{
+    if (context.pRtp)
+    {
+        RtpPacketizer& packetizer = (*context.pPacketizers)[packet.slice_offset];
+        const uint32_t uCount = packetizer.Finish(last);
+        packet.buffer.bytes = nullptr;
+        packet.buffer.size = packetizer.Bytes();
+        TRACE_SCOPE("output", packet.buffer.size);
+        context.pRtp->out(&packet, packetizer.Payloads(), uCount, context.pRtp->user);
+    }
+    else if (context.pDelivery)
+    {
+        const size_t szQueue = context.pSliceRows ? packet.slice_offset : 0u;
+        context.pDelivery->Push(szQueue, context.uFrame, packet, last, context.pOutput, context.pUser);
+    }
+    else
+    {
+        TRACE_SCOPE("output", packet.buffer.size);
+        context.pOutput(&packet, context.pUser);
+    }
+}
+
 inline void X264Encoder::Logging(void*, int level, const char* fmt, va_list vars)
 {
-    if (level > 0)
+    if (level > 0 && LoggingEnabled(static_cast<LogLevel>(level + 4)))
     {
         char buf[2048];
         va_list args;
@@ -137,10 +375,21 @@ inline void X264Encoder::Logging(void*, int level, const char* fmt, va_list vars
 
 inline X264Encoder::X264Encoder()
     : m_pHandle(nullptr)
+    , m_param({})
+    , m_options({})
+    , m_activeOptions({})
     , m_picture({})
+    , m_pSegmentOutput(nullptr)
+    , m_rtp({})
+    , m_nFrameIndex(0)
     , m_uSliceMode(0)
     , m_uSliceCount(0)
-    , m_uMBsPerSlice(0u)
+    , m_uThreads(0u)
+    , m_uWidth(0u)
+    , m_uHeight(0u)
+    , m_bFlushed(false)
+    , m_bForceIntra(false)
+    , m_bIntraRefresh(false)
 {
 }
 
@@ -151,6 +400,7 @@ inline X264Encoder::~X264Encoder()
 
 inline int32_t X264Encoder::Config(const NVIVideoCodecParam& param)
 {
+    TRACE_SCOPE("config", param.width * param.height);
     if (m_pHandle)
     {
         return -1;
@@ -168,30 +418,71 @@ inline int32_t X264Encoder::Config(const NVIVideoCodecParam& param)
     {
         return -3;
     }
-    int nThreads = (param.height + kSliceLines - 1) / kSliceLines;
+    const bool bThroughput = m_options.tuning == X2645Tuning_Throughput;
+    const bool bBatch = m_options.tuning == X2645Tuning_Batch;
     if (param.slice_mode == 0)
     {
         m_uSliceMode = 0u;
     }
-    else if (param.slice_mode == NVISliceMode_MultiSlice)
+    else if (param.slice_mode == NVISliceMode_MultiSlice && (m_options.tuning == X2645Tuning_ZeroLatency || m_options.tuning == X2645Tuning_Parallel))
     {
         m_uSliceMode = param.slice_mode | NVISliceMode_InOrder;
     }
     else
     {
-        return -4;
+        return -4;  // nalu_process不支持帧级多线程，Batch模式为单线程编码
+    }
+    EncoderPoolEntry entry;
+    if (!bThroughput && EncoderPool::Instance().Take(NVICodec_AVC, param, m_options, entry))
+    {
+        return Reuse(param, entry);
     }
-    m_uSliceCount = static_cast<uint16_t>(nThreads);
-    m_uMBsPerSlice = ((param.width + 15) >> 4) * (kSliceLines >> 4);
     x264_param_t X264Param{};
     X264Param.i_log_level = X264_LOG_NONE;
-    x264_param_default_preset(&X264Param, x264_preset_names[0], x264_tune_names[7]);
-    //* cpuFlags
-    X264Param.i_threads = nThreads /*X264_THREADS_AUTO*/ /*X264_SYNC_LOOKAHEAD_AUTO*/;
-    //X264Param.b_sliced_threads = 1; // auto set by x264_param_default_preset()
+    if (bThroughput)
+    {
+        // 帧级多线程 + lookahead + B帧，按CPU核数申请线程
+        m_uThreads = WorkerPool::Instance().Acquire(std::max(std::thread::hardware_concurrency(), 1u));
+        m_uSliceCount = 1u;
+        m_vecSliceRows.clear();
+        x264_param_default_preset(&X264Param, x264_preset_names[0], nullptr);
+        X264Param.i_threads = static_cast<int>(m_uThreads);
+        X264Param.b_sliced_threads = 0;
+        X264Param.i_sync_lookahead = X264_SYNC_LOOKAHEAD_AUTO;
+    }
+    else if (bBatch)
+    {
+        // 由批量调度的工作线程驱动，编码器内部不创建线程，也不占用线程池预算
+        m_uThreads = 0u;
+        m_uSliceCount = 1u;
+        m_vecSliceRows.clear();
+        x264_param_default_preset(&X264Param, x264_preset_names[0], x264_tune_names[7]);
+        X264Param.i_threads = 1;
+        X264Param.b_sliced_threads = 0;
+        X264Param.i_lookahead_threads = 1;
+    }
+    else
+    {
+        // 按slice布局申请线程，线程池不足时减少线程，sliced threads下每个线程编码一个slice
+        const uint32_t uSlices = m_uSliceMode != 0 ? X264SliceCount(m_options, param.height, kSliceLines) : (param.height + kSliceLines - 1) / kSliceLines;
+        m_uThreads = WorkerPool::Instance().Acquire(uSlices);  // MaxBytes模式为单线程
+        m_uSliceCount = uSlices > 0u ? static_cast<uint16_t>(m_uThreads) : 0u;
+        X264SliceRows(param.height, m_uThreads, m_vecSliceRows);
+        x264_param_default_preset(&X264Param, x264_preset_names[0], x264_tune_names[7]);
+        //* cpuFlags
+        X264Param.i_threads = static_cast<int>(m_uThreads) /*X264_THREADS_AUTO*/ /*X264_SYNC_LOOKAHEAD_AUTO*/;
+        //X264Param.b_sliced_threads = 1; // auto set by x264_param_default_preset()
+        if (uSlices > 0u && m_uThreads < uSlices)
+        {
+            LOG_INFO("X264Encoder slice count reduced from {} to {} by worker pool.", uSlices, m_uThreads);
+        }
+    }
     //* 视频选项
     X264Param.i_width = static_cast<int>(param.width);
     X264Param.i_height = static_cast<int>(param.height);
+    m_uWidth = param.width;
+    m_uHeight = param.height;
+    m_param = param;
     X264Param.i_csp = nCSP;
     //X264Param.i_frame_total = 0;
 
@@ -202,11 +493,21 @@ inline int32_t X264Encoder::Config(const NVIVideoCodecParam& param)
     X264Param.vui.b_fullrange = param.colorspace.range == NVIRange_Full ? 1 : 0;
 
     //* 流参数
-    X264Param.b_repeat_headers = 1;
+    // 带外参数集模式下只能通过x264_encoder_headers()获取SPS/PPS
+    X264Param.b_repeat_headers = m_options.oob_headers != 0u ? 0 : 1;
     X264Param.b_annexb = 1;
-    X264Param.i_bframe = 0;
-    X264Param.i_slice_count = m_uSliceCount;
-    X264Param.i_slice_count_max = m_uSliceCount;
+    X264Param.i_bframe = bThroughput ? kThroughputBFrames : 0;
+    if (!bThroughput && m_uSliceCount > 0u)
+    {
+        X264Param.i_slice_count = m_uSliceCount;
+        X264Param.i_slice_count_max = m_uSliceCount;
+    }
+    else if (!bThroughput)
+    {
+        // 超过i_slice_max_size(不含起始码)时开始新的slice，达到i_slice_count_max后不再拆分
+        X264Param.i_slice_max_size = static_cast<int>(m_options.slice_value);
+        X264Param.i_slice_count_max = X2645_MAX_SLICES;
+    }
 
     //* 速率控制参数
     X264Param.rc.i_bitrate = static_cast<int>(param.avg_bitrate);
@@ -234,12 +535,18 @@ inline int32_t X264Encoder::Config(const NVIVideoCodecParam& param)
     X264Param.i_fps_den = param.frame_rate_den;
     X264Param.i_timebase_num = 1u;
     X264Param.i_timebase_den = 90000u;
+    // pts为输入帧序号，码率控制使用固定帧率
+    X264Param.b_vfr_input = 0;
     X264Param.i_keyint_max = static_cast<int>(param.gop);
     X264Param.i_keyint_min = X264Param.i_keyint_max;
     X264Param.b_open_gop = 0;
+    // 帧内刷新：i_keyint_max为刷新周期，帧内宏块列逐帧移动，避免周期IDR的码率尖峰
+    X264Param.b_intra_refresh = m_options.intra_refresh != 0u ? 1 : 0;
 
-    //关闭自适应I帧决策。
-    X264Param.i_scenecut_threshold = 0;
+    //关闭自适应I帧决策。吞吐模式有lookahead，场景切换检测、AQ和direct预测使用x264的默认值(ultrafast预设会关闭它们)
+    x264_param_t defaults{};
+    x264_param_default(&defaults);
+    X264Param.i_scenecut_threshold = bThroughput ? defaults.i_scenecut_threshold : 0;
 
     //设置亚像素估计的复杂度。值越高越好。级别1-5简单控制亚像素的细化力度。级别6给模式决策开启RDO（码率失真优化模式），
     //级别8给运动矢量和帧内预测模式开启RDO。开启RDO会显著增加耗时。
@@ -249,7 +556,7 @@ inline int32_t X264Encoder::Config(const NVIVideoCodecParam& param)
     //为mb-tree ratecontrol（Macroblock Tree Ratecontrol）和vbv-lookahead设置可用的帧的数量。最大可设置为250。
     //对于mb-tree而言，调大这个值会得到更准确地结果，但也会更慢。
     //mb-tree能使用的最大值是–rc-lookahead和–keyint中较小的那一个。
-    X264Param.rc.i_lookahead = 0;
+    X264Param.rc.i_lookahead = bThroughput ? std::min(kThroughputLookahead, X264Param.i_keyint_max) : 0;
 
     //i_luma_deadzone[0]和i_luma_deadzone[1]分别对应inter和intra，取值范围1~32
     //这个参数的调整可以对数据量有很大影响，值越大数据量相应越少，占用带宽越低.
@@ -258,11 +565,18 @@ inline int32_t X264Encoder::Config(const NVIVideoCodecParam& param)
 
     //自适应量化器模式。不使用自适应量化的话，x264趋向于使用较少的bit在缺乏细节的场景里。自适应量化可以在整个视频的宏块里更好地分配比特。它有以下选项：
     //0-完全关闭自适应量化器;1-允许自适应量化器在所有视频帧内部分配比特;2-根据前一帧强度决策的自变量化器（实验性的）。默认值=1
-    X264Param.rc.i_aq_mode = 0;
+    X264Param.rc.i_aq_mode = bThroughput ? defaults.rc.i_aq_mode : X264_AQ_NONE;
+    X264Param.rc.f_aq_strength = defaults.rc.f_aq_strength;
+    if ((m_options.roi != 0u || m_options.static_qp != 0u) && X264Param.rc.i_aq_mode == X264_AQ_NONE)
+    {
+        // quant_offsets只在开启AQ时生效，x264在强度为0时会关闭AQ，使用很小的强度只保留外部偏移
+        X264Param.rc.i_aq_mode = X264_AQ_VARIANCE;
+        X264Param.rc.f_aq_strength = kQuantMapAqStrength;
+    }
 
     //为’direct’类型的运动矢量设定预测模式。有两种可选的模式：spatial（空间预测）和temporal（时间预测）。默认：’spatial’
     //可以设置为’none’关闭预测，也可以设置为’auto’让x264去选择它认为更好的模式，x264会在编码结束时告诉你它的选择。
-    X264Param.analyse.i_direct_mv_pred = X264_DIRECT_PRED_NONE;
+    X264Param.analyse.i_direct_mv_pred = bThroughput ? defaults.analyse.i_direct_mv_pred : X264_DIRECT_PRED_NONE;
 
     //开启明确的权重预测以增进P帧压缩。越高级的模式越耗时，有以下模式：
     //0 : 关闭; 1 : 静态补偿（永远为-1）; 2 : 智能统计静态帧，特别为增进淡入淡出效果的压缩率而设计
@@ -313,19 +627,15 @@ inline int32_t X264Encoder::Config(const NVIVideoCodecParam& param)
     //去掉信噪比的计算，因为在解码端也可用到.
     X264Param.analyse.b_psnr = 0;  //是否使用信噪比.
 
-    if (m_uSliceMode != 0 && m_uSliceCount > 1)
+    if (m_uSliceMode != 0 && m_uSliceCount != 1)
     {
         X264Param.nalu_process = &X264Encoder::NaluProcess;
-        m_vecStreamBuffer.resize(m_uSliceCount);
+        m_vecStreamBuffer.resize(std::max<size_t>(m_uSliceCount, 1u));
     }
     else
     {
         m_vecStreamBuffer.resize(1ull);
     }
-    for (auto& item : m_vecStreamBuffer)
-    {
-        item.reset(new uint8_t[kBufferSize]);
-    }
 
     //* 设置Profile.使用main profile
     if (param.profile == 0 || param.profile >= 77u)
@@ -337,75 +647,571 @@ inline int32_t X264Encoder::Config(const NVIVideoCodecParam& param)
         x264_param_apply_profile(&X264Param, x264_profile_names[0]);  // "baseline"
     }
 
-    // log callback
+    // log callback，x264内部按i_log_level过滤，低于阈值的日志不会回调
     X264Param.pf_log = X264Encoder::Logging;
+    X264Param.i_log_level = std::max(std::min(LoggingLevel() - 4, static_cast<int>(X264_LOG_INFO)), static_cast<int>(X264_LOG_NONE));
 
     //* 打开编码器
-    m_pHandle = x264_encoder_open(&X264Param);
+    {
+        WorkerPool::Placement placement;
+        m_pHandle = x264_encoder_open(&X264Param);
+    }
     if (m_pHandle)
     {
         //创建X264图像容器
         x264_picture_init(&m_picture);
+        const size_t szDelay = static_cast<size_t>(x264_encoder_maximum_delayed_frames(m_pHandle));
+        m_vecFrameInfo.assign(szDelay + 1u, FrameInfo{});
+        m_frameStats.Config(m_options.frame_stats != 0u, szDelay, static_cast<uint32_t>(X264Param.rc.i_vbv_max_bitrate),
+                            static_cast<uint32_t>(X264Param.rc.i_vbv_buffer_size), param.frame_rate_num, param.frame_rate_den);
+        m_nFrameIndex = 0;
+        m_activeOptions = m_options;
+        m_quantMap.Config(m_options.roi != 0u || m_options.static_qp != 0u, m_uWidth, m_uHeight, 1u, m_options.static_qp);
+        m_governor.Reset(X2645_SPEED_DEFAULT);
+        m_admission.Reset(param.frame_rate_num, param.frame_rate_den);
+        m_bFlushed = false;
+        m_bForceIntra = false;
+        m_bIntraRefresh = false;
+        BuildHeaders();
+        OpenMuxer();
+        StartDelivery();
         LOG_NOTICE("X264Encoder opened handle[{}], libx264 version " LIBX264_VERSION ".", (void*)m_pHandle);
         return 0;
     }
+    WorkerPool::Instance().Release(m_uThreads);
+    m_uThreads = 0u;
     return -1;
 }
 
+inline int32_t X264Encoder::Reuse(const NVIVideoCodecParam& param, EncoderPoolEntry& entry)
+{
+    m_pHandle = static_cast<x264_t*>(entry.handle);
+    m_uThreads = entry.threads;
+    m_nFrameIndex = entry.frame_index;  // pts保持递增
+    m_uWidth = param.width;
+    m_uHeight = param.height;
+    m_param = param;
+    x264_picture_init(&m_picture);
+    x264_param_t X264Param{};
+    x264_encoder_parameters(m_pHandle, &X264Param);
+    m_uSliceCount = X264Param.i_slice_max_size > 0 ? 0u : static_cast<uint16_t>(std::max(m_uThreads, 1u));
+    X264SliceRows(param.height, m_uSliceCount, m_vecSliceRows);
+    m_vecStreamBuffer.resize(m_uSliceMode != 0 && m_uSliceCount != 1 ? std::max<size_t>(m_uSliceCount, 1u) : 1ull);
+    const size_t szDelay = static_cast<size_t>(x264_encoder_maximum_delayed_frames(m_pHandle));
+    m_vecFrameInfo.assign(szDelay + 1u, FrameInfo{});
+    m_frameStats.Config(m_options.frame_stats != 0u, szDelay, static_cast<uint32_t>(X264Param.rc.i_vbv_max_bitrate),
+                        static_cast<uint32_t>(X264Param.rc.i_vbv_buffer_size), param.frame_rate_num, param.frame_rate_den);
+    m_activeOptions = m_options;
+    m_quantMap.Config(m_options.roi != 0u || m_options.static_qp != 0u, m_uWidth, m_uHeight, 1u, m_options.static_qp);
+    m_governor.Reset(X2645_SPEED_DEFAULT);  // 放回缓存前已恢复默认级别
+    m_admission.Reset(param.frame_rate_num, param.frame_rate_den);
+    m_bFlushed = false;
+    m_bForceIntra = true;  // 参考帧属于上一个使用者
+    m_bIntraRefresh = false;
+    BuildHeaders();
+    OpenMuxer();
+    StartDelivery();
+    LOG_INFO("X264Encoder reused handle[{}].", (void*)m_pHandle);
+    return 0;
+}
+
+inline void X264Encoder::BuildHeaders()
+{
+    m_headers.Reset(NVICodec_AVC);
+    int iNal = 0;
+    x264_nal_t* pNals = nullptr;
+    if (x264_encoder_headers(m_pHandle, &pNals, &iNal) > 0)
+    {
+        for (int i = 0; i < iNal; ++i)
+        {
+            m_headers.Add(pNals[i].p_payload, static_cast<size_t>(pNals[i].i_payload));
+        }
+    }
+    if (!m_headers.Build())
+    {
+        LOG_WARNING("X264Encoder handle[{}] failed to build avcC.", (void*)m_pHandle);
+    }
+}
+
+inline bool X264Encoder::OpenMuxer()
+{
+    X2645StreamHeaders headers{};
+    if (!m_muxer.Configured() || !m_headers.Query(headers))
+    {
+        return false;
+    }
+    x264_param_t X264Param{};
+    x264_encoder_parameters(m_pHandle, &X264Param);
+    const uint32_t uDelay = X264Param.i_bframe > 0 ? (X264Param.i_bframe_pyramid != 0 ? 2u : 1u) : 0u;
+    // 多Slice模式下只封装回调输出的slice，关键帧的参数集由封装插入
+    const bool bSliceCallback = m_uSliceMode != 0 && m_uSliceCount != 1;
+    return m_muxer.Open(m_param, uDelay, X264Param.b_repeat_headers != 0 && !bSliceCallback, headers);
+}
+
+inline void X264Encoder::StartDelivery()
+{
+    // 只有nalu_process输出slice时需要，固定slice布局每个slice一个队列
+    if (m_uSliceMode != 0 && m_uSliceCount != 1 && m_activeOptions.slice_delivery == X2645SliceDelivery_Ordered)
+    {
+        m_delivery.Start(std::max<size_t>(m_uSliceCount, 1u));
+    }
+    else
+    {
+        m_delivery.Stop();
+    }
+}
+
+inline void X264Encoder::ClosePooled(EncoderPoolEntry& entry)
+{
+    x264_encoder_close(static_cast<x264_t*>(entry.handle));
+    WorkerPool::Instance().Release(entry.threads);
+    entry.handle = nullptr;
+    entry.threads = 0u;
+}
+
 inline int32_t X264Encoder::Encoding(const NVIVideoImageFrame& in, NVIVideoEncode::OnPacket out, void* user)
 {
     if (m_pHandle == nullptr)
     {
         return -1;
     }
+    if (m_bFlushed)
+    {
+        return -3;  // 冲刷已结束lookahead线程
+    }
+    TRACE_SCOPE("encode", m_nFrameIndex);
+    const int64_t nBegin = m_governor.Enabled() || m_admission.Enabled() ? SteadyNanoseconds() : 0;
+    // 过载时在转换和编码之前丢弃，请求的关键帧总是编码
+    bool bKeyOnly = false;
+    if (m_admission.Enabled() && !m_admission.Admit(in.info.tick.value, in.info.frame_kind == NVIFrameKind_Intra || m_bForceIntra, nBegin, bKeyOnly))
+    {
+        return 0;
+    }
     x264_picture_init(&m_picture);
-    if (!PicturePalneCopy(in, m_picture))
+    const NVIPixelFormat format = static_cast<NVIPixelFormat>(in.buffer.format);
+    const NVIVideoImageFrame* pFrame = m_converter.Convert(in, m_uWidth, m_uHeight, X264NativeFormat(format));
+    if (pFrame == nullptr || !PicturePalneCopy(*pFrame, m_picture))
     {
         return -2;
     }
-    m_picture.i_type = in.info.frame_kind == NVIFrameKind_Intra ? X264_TYPE_IDR : X264_TYPE_AUTO;
+    // x264在x264_encoder_encode中读取偏移表，不需要保留到延迟帧输出
+    m_picture.prop.quant_offsets = const_cast<float*>(m_quantMap.Build(pFrame->buffer.planes[0], pFrame->buffer.strides[0]));
+    const bool bForceIntra = m_bForceIntra.exchange(false) || bKeyOnly;
+    m_picture.i_type = in.info.frame_kind == NVIFrameKind_Intra || bForceIntra ? X264_TYPE_IDR : X264_TYPE_AUTO;
+    // 有延迟帧时输出顺序与输入不同，用pts找回输入帧的信息
+    m_picture.i_pts = m_nFrameIndex++;
+    m_vecFrameInfo[static_cast<size_t>(m_picture.i_pts) % m_vecFrameInfo.size()] = in.info;
+    if (m_frameStats.Enabled())
+    {
+        m_frameStats.Begin();
+        m_frameStats.Submit(static_cast<size_t>(m_picture.i_pts));
+    }
+    if (m_bIntraRefresh.exchange(false) && !bForceIntra)
+    {
+        x264_encoder_intra_refresh(m_pHandle);
+    }
+    const int32_t nResult = EncodeFrame(&m_picture, out, user);
+    if (m_admission.Enabled())
+    {
+        m_admission.Finish(SteadyNanoseconds() - nBegin);
+    }
+    if (m_governor.Enabled())
+    {
+        GovernSpeed(nBegin);
+    }
+    return nResult;
+}
+
+inline int32_t X264Encoder::Flush(NVIVideoEncode::OnPacket out, void* user)
+{
+    if (m_pHandle == nullptr)
+    {
+        return -1;
+    }
+    TRACE_SCOPE("flush", x264_encoder_delayed_frames(m_pHandle));
+    if (m_frameStats.Enabled())
+    {
+        m_frameStats.Begin();
+    }
+    int32_t nTotal = 0;
+    while (x264_encoder_delayed_frames(m_pHandle) > 0)
+    {
+        m_bFlushed = true;  // 冲刷会结束lookahead线程，之后不能再复用
+        int32_t nEncode = EncodeFrame(nullptr, out, user);
+        if (nEncode < 0)
+        {
+            return nEncode;
+        }
+        nTotal += nEncode;
+    }
+    m_delivery.Drain();
+    m_muxer.Finish();
+    return nTotal;
+}
+
+inline int32_t X264Encoder::EncodeFrame(x264_picture_t* pic, NVIVideoEncode::OnPacket out, void* user)
+{
     NVIVideoEncodedPacket packet{};
-    packet.info = in.info;
+    if (pic)
+    {
+        packet.info = m_vecFrameInfo[static_cast<size_t>(pic->i_pts) % m_vecFrameInfo.size()];
+    }
     packet.slice_mode = m_uSliceMode;
     packet.slice_count = m_uSliceCount;
-    packet.pixel_format = in.buffer.format;
+    packet.pixel_format = m_param.format;
     EncodeContext context(packet, m_vecStreamBuffer);
     context.pOutput = out;
     context.pUser = user;
-    context.uMBsPerSlice = m_uMBsPerSlice;
-    m_picture.opaque = &context;
+    if (m_uSliceMode != 0)
+    {
+        context.pSliceRows = m_uSliceCount > 0u ? &m_vecSliceRows : nullptr;
+        context.uMBWidth = (m_uWidth + 15) >> 4;
+    }
+    if (m_rtp.out)
+    {
+        const size_t szSlots = m_vecRtp.size();
+        if (szSlots < m_vecStreamBuffer.size())
+        {
+            m_vecRtp.resize(m_vecStreamBuffer.size());
+            for (size_t i = szSlots; i < m_vecRtp.size(); ++i)
+            {
+                m_vecRtp[i].Config(NVICodec_AVC, m_rtp.mtu);
+            }
+        }
+        for (auto& item : m_vecRtp)
+        {
+            item.Reset();
+        }
+        context.pRtp = &m_rtp;
+        context.pPacketizers = &m_vecRtp;
+    }
+    if (m_delivery.Running() && context.pRtp == nullptr)
+    {
+        context.pDelivery = &m_delivery;
+        context.uFrame = m_delivery.BeginFrame();
+    }
+    if (pic)
+    {
+        pic->opaque = &context;
+        context.pStats = m_frameStats.Enabled() ? &m_frameStats : nullptr;
+    }
     int iNal = -1;
     x264_nal_t* pNals = nullptr;
     x264_picture_t picOut{};
-    int nEncode = x264_encoder_encode(m_pHandle, &pNals, &iNal, &m_picture, &picOut);
-    if (nEncode > 0 && context.uSliceNumber == 0u && out)
+    int nEncode = x264_encoder_encode(m_pHandle, &pNals, &iNal, pic, &picOut);
+    if (context.pSliceRows == nullptr && context.uSliceNumber > 0u)
     {
-        packet.info.frame_kind = X264_TYPE_IDR == picOut.i_type || X264_TYPE_I == picOut.i_type ? NVIFrameKind_Intra : NVIFrameKind_Delta;
-        uint8_t* pData = m_vecStreamBuffer[0].get();
-        size_t& szData = packet.buffer.size;
-        szData = 0ull;
-        for (int i = 0; i < iNal; ++i)
+        context.pending.slice_count = static_cast<uint16_t>(context.uSliceNumber);
+        SliceOutput(context, context.pending, true);
+    }
+    if (context.pDelivery)
+    {
+        m_delivery.EndFrame();
+        if (m_delivery.TakeOverflow())
         {
-            memcpy(pData + szData, pNals[i].p_payload, pNals[i].i_payload);
-            szData += static_cast<size_t>(pNals[i].i_payload);
+            // 丢弃的slice可能被后续帧参考，从下一帧开始重新建立参考
+            m_bForceIntra = true;
+            LOG_WARNING("X264Encoder slice delivery queue full, slices dropped, forcing IDR.");
         }
-        packet.buffer.bytes = pData;
+    }
+    if (nEncode > 0 && context.uSliceNumber == 0u)
+    {
+        packet.info = m_vecFrameInfo[static_cast<size_t>(picOut.i_pts) % m_vecFrameInfo.size()];
+        packet.info.frame_kind = X264_TYPE_IDR == picOut.i_type || X264_TYPE_I == picOut.i_type ? NVIFrameKind_Intra : NVIFrameKind_Delta;
         packet.slice_mode = 0;
         packet.slice_count = 1;
         packet.slice_offset = 0;
         packet.slice_number = 1;
+    }
+    if (nEncode > 0 && m_frameStats.Enabled())
+    {
+        // x264输出的i_qpplus1为帧平均QP+1
+        const float fQP = static_cast<float>(picOut.i_qpplus1 - 1);
+        m_frameStats.Finish(static_cast<size_t>(picOut.i_pts), packet.info.tick.value, X264FrameType(picOut.i_type), fQP, static_cast<size_t>(nEncode));
+    }
+    if (nEncode > 0 && context.uSliceNumber == 0u && m_rtp.out)
+    {
+        RtpPacketizer& packetizer = m_vecRtp.front();
+        for (int i = 0; i < iNal; ++i)
+        {
+            packetizer.Add(pNals[i].p_payload, static_cast<size_t>(pNals[i].i_payload));
+        }
+        const uint32_t uCount = packetizer.Finish(true);
+        packet.buffer.bytes = nullptr;
+        packet.buffer.size = packetizer.Bytes();
+        TRACE_SCOPE("output", packet.buffer.size);
+        m_rtp.out(&packet, packetizer.Payloads(), uCount, m_rtp.user);
+    }
+    else if (nEncode > 0 && context.uSliceNumber == 0u && m_pSegmentOutput)
+    {
+        m_vecSegments.resize(static_cast<size_t>(iNal));
+        packet.buffer.size = 0ull;
+        for (int i = 0; i < iNal; ++i)
+        {
+            X2645NalSegment& segment = m_vecSegments[static_cast<size_t>(i)];
+            segment.bytes = pNals[i].p_payload;
+            segment.size = static_cast<size_t>(pNals[i].i_payload);
+            segment.nal_type = static_cast<uint32_t>(pNals[i].i_type);
+            packet.buffer.size += segment.size;
+        }
+        packet.buffer.bytes = nullptr;
+        TRACE_SCOPE("output", packet.buffer.size);
+        m_pSegmentOutput(&packet, m_vecSegments.data(), static_cast<uint32_t>(m_vecSegments.size()), user);
+    }
+    else if (nEncode > 0 && context.uSliceNumber == 0u && out)
+    {
+        uint8_t* pData = m_vecStreamBuffer[0].Reserve(static_cast<size_t>(nEncode));
+        size_t& szData = packet.buffer.size;
+        szData = 0ull;
+        {
+            TRACE_SCOPE("copy", nEncode);
+            for (int i = 0; i < iNal; ++i)
+            {
+                memcpy(pData + szData, pNals[i].p_payload, pNals[i].i_payload);
+                szData += static_cast<size_t>(pNals[i].i_payload);
+            }
+        }
+        m_vecStreamBuffer[0].Commit(szData);
+        packet.buffer.bytes = pData;
+        TRACE_SCOPE("output", szData);
         out(&packet, user);
     }
+    if (nEncode > 0 && m_muxer.Opened())
+    {
+        TRACE_SCOPE("mux", nEncode);
+        m_muxer.BeginFrame(picOut.b_keyframe != 0, picOut.i_pts, m_vecFrameInfo[static_cast<size_t>(picOut.i_pts) % m_vecFrameInfo.size()].tick.value);
+        if (context.uSliceNumber > 0u)
+        {
+            // 开启nalu_process时x264返回的NAL无效，使用回调写入缓存的slice，参数集由封装按带外方式插入
+            for (size_t i = 0; i < X2645_MAX_SLICES; ++i)
+            {
+                if (context.szSliceNal[i] > 0u)
+                {
+                    m_muxer.AddNal(context.pSliceNal[i], context.szSliceNal[i]);
+                }
+            }
+        }
+        else
+        {
+            for (int i = 0; i < iNal; ++i)
+            {
+                m_muxer.AddNal(pNals[i].p_payload, static_cast<size_t>(pNals[i].i_payload));
+            }
+        }
+        m_muxer.EndFrame();
+    }
     return nEncode;
 }
 
 inline void X264Encoder::Release()
 {
+    m_delivery.Stop();
+    m_muxer.Finish();
+    // 未冲刷过的ZeroLatency/Batch编码器没有延迟帧，可以留给相同配置的实例复用
+    if (m_pHandle && m_activeOptions.tuning != X2645Tuning_Throughput && !m_bFlushed)
+    {
+        if (m_governor.Level() != X2645_SPEED_DEFAULT)
+        {
+            ApplySpeedLevel(X2645_SPEED_DEFAULT);
+        }
+        EncoderPoolEntry entry;
+        entry.codec = NVICodec_AVC;
+        entry.param = m_param;
+        entry.options = m_activeOptions;
+        entry.handle = m_pHandle;
+        entry.threads = m_uThreads;
+        entry.frame_index = m_nFrameIndex;
+        entry.close = &X264Encoder::ClosePooled;
+        if (EncoderPool::Instance().Put(entry))
+        {
+            m_pHandle = nullptr;
+            m_uThreads = 0u;
+        }
+    }
     if (m_pHandle)
     {
         x264_encoder_close(m_pHandle);
         m_pHandle = nullptr;
     }
+    m_vecStreamBuffer.clear();
+    WorkerPool::Instance().Release(m_uThreads);
+    m_uThreads = 0u;
+}
+
+inline int32_t X264Encoder::Reconfig(const NVIVideoCodecParam& param, uint32_t fields, uint32_t& rejected)
+{
+    rejected = 0u;
+    if (m_pHandle == nullptr)
+    {
+        return -1;
+    }
+    x264_param_t X264Param{};
+    x264_encoder_parameters(m_pHandle, &X264Param);
+    // 码率控制按打开时的固定帧率计算，x264_encoder_reconfig不支持修改帧率；VBV不能在线开启或关闭；CRF下不使用平均码率
+    const bool bVbv = X264Param.rc.i_vbv_max_bitrate > 0 && X264Param.rc.i_vbv_buffer_size > 0;
+    rejected |= fields & X2645Reconfig_FrameRate;
+    if (!bVbv)
+    {
+        rejected |= fields & (X2645Reconfig_MaxBitrate | X2645Reconfig_Vbv);
+    }
+    else if (param.max_bitrate == 0u)
+    {
+        rejected |= fields & X2645Reconfig_MaxBitrate;
+    }
+    if (X264Param.rc.i_rc_method == X264_RC_CRF)
+    {
+        rejected |= fields & X2645Reconfig_AvgBitrate;
+    }
+    fields &= ~rejected;
+    if (fields == 0u)
+    {
+        return 0;
+    }
+    if (fields & X2645Reconfig_AvgBitrate)
+    {
+        X264Param.rc.i_bitrate = static_cast<int>(param.avg_bitrate);
+    }
+    if (fields & X2645Reconfig_MaxBitrate)
+    {
+        X264Param.rc.i_vbv_max_bitrate = static_cast<int>(param.max_bitrate);
+    }
+    // vbv为0时与打开时一致，按最大码率取10帧的数据量
+    if ((fields & X2645Reconfig_Vbv) || ((fields & X2645Reconfig_MaxBitrate) && m_param.vbv == 0u))
+    {
+        const int64_t nDerived = static_cast<int64_t>(X264Param.rc.i_vbv_max_bitrate) * X264Param.i_fps_den * 10 / std::max(X264Param.i_fps_num, 1u);
+        X264Param.rc.i_vbv_buffer_size = (fields & X2645Reconfig_Vbv) && param.vbv > 0 ? static_cast<int>(param.vbv) : static_cast<int>(nDerived);
+    }
+    if (fields & X2645Reconfig_Quality)
+    {
+        X264Param.rc.f_rf_constant = param.quality > 0 && param.quality <= 51 ? static_cast<float>(param.quality) : 23.0f;
+    }
+    if (x264_encoder_reconfig(m_pHandle, &X264Param) < 0)
+    {
+        rejected |= fields;
+        return -3;
+    }
+    m_param.avg_bitrate = (fields & X2645Reconfig_AvgBitrate) ? param.avg_bitrate : m_param.avg_bitrate;
+    m_param.max_bitrate = (fields & X2645Reconfig_MaxBitrate) ? param.max_bitrate : m_param.max_bitrate;
+    m_param.vbv = (fields & X2645Reconfig_Vbv) ? param.vbv : m_param.vbv;
+    m_param.quality = (fields & X2645Reconfig_Quality) ? param.quality : m_param.quality;
+    m_frameStats.ConfigVbv(static_cast<uint32_t>(X264Param.rc.i_vbv_max_bitrate), static_cast<uint32_t>(X264Param.rc.i_vbv_buffer_size),
+                           m_param.frame_rate_num, m_param.frame_rate_den);
+    return 0;
+}
+
+inline int32_t X264Encoder::IntraRefresh()
+{
+    if (m_pHandle == nullptr)
+    {
+        return -1;
+    }
+    // x264_encoder_intra_refresh不能与x264_encoder_encode同时调用，留到编码线程中执行
+    if (m_activeOptions.intra_refresh != 0u)
+    {
+        m_bIntraRefresh = true;
+        return 0;
+    }
+    m_bForceIntra = true;
+    return 1;
+}
+
+inline void X264Encoder::SetOptions(const X2645EncodeOptions& options)
+{
+    m_options = options;
+}
+
+inline void X264Encoder::SetSegmentOutput(X2645OnSegments out)
+{
+    m_pSegmentOutput = out;
+}
+
+inline void X264Encoder::SetRtpOutput(const X2645RtpConfig& config)
+{
+    m_rtp = config;
+    m_vecRtp.clear();  // 下一帧按slice数重新分配
+}
+
+inline int32_t X264Encoder::SetMuxOutput(const X2645MuxConfig* config)
+{
+    m_muxer.Config(config);
+    if (m_pHandle && m_muxer.Configured())
+    {
+        return OpenMuxer() ? 0 : -2;
+    }
+    return 0;
+}
+
+inline int32_t X264Encoder::SetRoi(const X2645RoiRegion* regions, uint32_t count)
+{
+    if (!m_quantMap.Enabled())
+    {
+        return -2;
+    }
+    m_quantMap.SetRegions(regions, count);
+    return 0;
+}
+
+inline int32_t X264Encoder::SetSpeedGovernor(const X2645SpeedGovernorConfig* config)
+{
+    m_governor.Config(config);
+    if (config == nullptr && m_governor.Level() != X2645_SPEED_DEFAULT)
+    {
+        if (m_pHandle && !ApplySpeedLevel(X2645_SPEED_DEFAULT))
+        {
+            return -3;
+        }
+        m_governor.Reset(X2645_SPEED_DEFAULT);
+    }
+    return 0;
+}
+
+inline void X264Encoder::SetAdmission(const X2645AdmissionConfig* config)
+{
+    m_admission.Config(config);
+    m_admission.Reset(m_param.frame_rate_num, m_param.frame_rate_den);
+}
+
+inline bool X264Encoder::ApplySpeedLevel(uint32_t level)
+{
+    const X264SpeedLevel& speed = kX264SpeedLevels[level];
+    x264_param_t X264Param{};
+    x264_encoder_parameters(m_pHandle, &X264Param);
+    X264Param.analyse.i_me_method = speed.me;
+    X264Param.analyse.i_me_range = speed.range;
+    X264Param.analyse.intra = speed.partitions & (X264_ANALYSE_I4x4 | X264_ANALYSE_I8x8);
+    X264Param.analyse.inter = speed.partitions;
+    X264Param.analyse.b_fast_pskip = speed.fastPSkip;
+    X264Param.analyse.b_chroma_me = speed.chromaME;
+    return x264_encoder_reconfig(m_pHandle, &X264Param) >= 0;
+}
+
+inline void X264Encoder::GovernSpeed(int64_t begin)
+{
+    uint32_t uLevel = 0u;
+    if (!m_governor.Update(SteadyNanoseconds() - begin, m_param.frame_rate_num, m_param.frame_rate_den, uLevel))
+    {
+        return;
+    }
+    if (ApplySpeedLevel(uLevel))
+    {
+        m_governor.Commit(uLevel);
+    }
+    else
+    {
+        LOG_WARNING("X264Encoder reconfig speed level {} failed, governor stopped.", uLevel);
+        m_governor.Config(nullptr);
+    }
+}
+
+inline void X264Encoder::GetBufferStats(X2645BufferStats& stats) const
+{
+    stats = {};
+    for (const auto& item : m_vecStreamBuffer)
+    {
+        stats.capacity += item.Capacity();
+        stats.high_water = std::max<uint64_t>(stats.high_water, item.HighWater());
+    }
+    stats.pooled = StreamBufferPool::Instance().PooledBytes();
 }
 
 inline bool X264Encoder::PicturePalneCopy(const NVIVideoImageFrame& in, x264_picture_t& out)
@@ -415,6 +1221,7 @@ inline bool X264Encoder::PicturePalneCopy(const NVIVideoImageFrame& in, x264_pic
     {
     case X264_CSP_I420: out.img.i_plane = 3; break;
     case X264_CSP_NV12: out.img.i_plane = 2; break;
+    case X264_CSP_NV21: out.img.i_plane = 2; break;
     case X264_CSP_I422: out.img.i_plane = 3; break;
     default: return false;
     }
@@ -1,13 +1,31 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
 #include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 #include <NVI/Codec.h>
 #include <x265.h>
+#include "AdmissionControl.h"
+#include "Codec.h"
+#include "EncoderPool.h"
+#include "FrameStats.h"
+#include "ParameterSets.h"
+#include "PixelConvert.h"
+#include "QuantMap.h"
+#include "RtpPacketizer.h"
+#include "SpeedGovernor.h"
+#include "StreamBuffer.h"
+#include "StreamMuxer.h"
+#include "WorkerPool.h"
+#include "adaption/Clock.h"
 #include "adaption/Logging.h"
+#include "adaption/Trace.h"
 
 class X265Encoder final
 {
@@ -18,20 +36,79 @@ public:
 public:
     int32_t Config(const NVIVideoCodecParam& param);
     int32_t Encoding(const NVIVideoImageFrame& in, NVIVideoEncode::OnPacket out, void* user);
+    int32_t Flush(NVIVideoEncode::OnPacket out, void* user);
+    int32_t Reconfig(const NVIVideoCodecParam& param, uint32_t fields, uint32_t& rejected);
+    int32_t IntraRefresh();
     void Release();
+    void SetOptions(const X2645EncodeOptions& options);
+    void SetSegmentOutput(X2645OnSegments out);
+    bool HasSegmentOutput() const { return m_pSegmentOutput != nullptr; }
+    void SetRtpOutput(const X2645RtpConfig& config);
+    int32_t SetRoi(const X2645RoiRegion* regions, uint32_t count);
+    int32_t SetSpeedGovernor(const X2645SpeedGovernorConfig* config);
+    void SetAdmission(const X2645AdmissionConfig* config);
+    void GetAdmissionStats(X2645AdmissionStats& stats) const { m_admission.Stats(stats); }
+    int32_t SetMuxOutput(const X2645MuxConfig* config);
+    void GetBufferStats(X2645BufferStats& stats) const;
+    bool GetFrameStats(X2645FrameStats& stats) const { return m_frameStats.Query(stats); }
+    bool GetHeaders(X2645StreamHeaders& headers) const { return m_pHandle && m_headers.Query(headers); }
+    // x265在编码线程中按顺序输出slice，没有交付线程
+    bool GetSliceDeliveryStats(X2645SliceDeliveryStats&) const { return false; }
+    uint32_t Threads() const { return m_uThreads; }
+    const NVIVideoCodecParam& Param() const { return m_param; }
 
 private:
+    static void ClosePooled(EncoderPoolEntry& entry);
+    int32_t Reuse(const NVIVideoCodecParam& param, EncoderPoolEntry& entry);
+    int32_t EncodeFrame(x265_picture* pic, NVIVideoEncode::OnPacket out, void* user);
+    void SliceOutput(const x265_nal* pNals, uint32_t uNal, NVIVideoEncodedPacket& packet, NVIVideoEncode::OnPacket out, void* user);
+    void RtpOutput(const x265_nal* pNals, uint32_t uNal, NVIVideoEncodedPacket& packet, bool marker);
+    void FinishFrameStats(const x265_picture& picOut, const NVIVideoEncodedPacket& packet, const x265_nal* pNals, uint32_t uNal);
     bool PicturePalneCopy(const NVIVideoImageFrame& in, x265_picture& out);
+    void BuildHeaders();
+    bool OpenMuxer();
+    bool ApplySpeedLevel(uint32_t level);
+    void GovernSpeed(int64_t begin);
 
 private:
+    using FrameInfo = decltype(NVIVideoImageFrame::info);
+
     const x265_api* m_pAPI;
     x265_encoder* m_pHandle;
     x265_param* m_pParam;
-    std::vector<std::unique_ptr<uint8_t[]>> m_vecStreamBuffer;
+    NVIVideoCodecParam m_param;
+    X2645EncodeOptions m_options;
+    X2645EncodeOptions m_activeOptions;  // 当前打开的编码器使用的选项
+    PixelConverter m_converter;
+    FrameStatsRecorder m_frameStats;
+    ParameterSets m_headers;
+    QuantMap m_quantMap;
+    SpeedGovernor m_governor;
+    AdmissionControl m_admission;
+    StreamMuxer m_muxer;
+    StreamBuffer m_streamBuffer;
+    std::vector<X2645NalSegment> m_vecSegments;
+    std::vector<FrameInfo> m_vecFrameInfo;
+    X2645OnSegments m_pSegmentOutput;
+    X2645RtpConfig m_rtp;
+    RtpPacketizer m_rtpPacketizer;
+    size_t m_szFrameIndex;
+    std::string m_strPools;
+    uint32_t m_uThreads;
+    uint16_t m_uSliceMode;
+    uint16_t m_uSliceCount;
+    bool m_bFlushed;
+    std::atomic<bool> m_bForceIntra;    // 可在其他线程请求
+    std::atomic<bool> m_bIntraRefresh;  // 可在其他线程请求，在下一次编码前开始帧内刷新
 
-    const size_t kBufferSize = 2 * 1024 * 1024;
     const uint32_t kMaxFrameSize = 8192 * 8192;
     const uint32_t kMaxFrameRate = 60;
+    const int kThroughputBFrames = 3;
+    const int kThroughputLookahead = 20;
+    const int kMaxFrameThreads = 16;  // X265_MAX_FRAME_THREADS
+    const uint32_t kSliceLines = 272;
+    const uint32_t kParallelSliceRows = 16;  // Parallel模式下每个slice的CTU行数
+    const double kQuantMapAqStrength = 0.05;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -41,28 +118,96 @@ static int ToX265CSP(NVIPixelFormat format)
     switch (format)
     {
     case NVIPixel_I420: return X265_CSP_I420;
+    case NVIPixel_NV12: return X265_CSP_I420;
+    case NVIPixel_NV21: return X265_CSP_I420;
     case NVIPixel_420P10LE: return X265_CSP_I420;
     case NVIPixel_420P10BE: return X265_CSP_I420;
     case NVIPixel_422P: return X265_CSP_I422;
     case NVIPixel_422P10LE: return X265_CSP_I422;
     case NVIPixel_422P10BE: return X265_CSP_I422;
+    case NVIPixel_V210: return X265_CSP_I422;
+    case NVIPixel_UYVY: return X265_CSP_I422;
+    case NVIPixel_YUY2: return X265_CSP_I422;
     default: return 0;
     }
 }
 
+static uint32_t X265FrameType(int type)
+{
+    switch (type)
+    {
+    case X265_TYPE_IDR: return X2645FrameType_IDR;
+    case X265_TYPE_I: return X2645FrameType_I;
+    case X265_TYPE_P: return X2645FrameType_P;
+    case X265_TYPE_BREF:
+    case X265_TYPE_B: return X2645FrameType_B;
+    default: return X2645FrameType_Unknown;
+    }
+}
+
 static int FormatBitDepth(NVIPixelFormat format)
 {
-    if (format == NVIPixel_420P10LE || format == NVIPixel_420P10BE || format == NVIPixel_422P10LE || format == NVIPixel_422P10BE)
+    if (format == NVIPixel_420P10LE || format == NVIPixel_420P10BE || format == NVIPixel_422P10LE || format == NVIPixel_422P10BE ||
+        format == NVIPixel_V210)
     {
         return 10;
     }
     return 8;
 }
 
+/*
+ * 速度级别对应的分析参数，默认级别与ultrafast预设一致。
+ * x265_encoder_reconfig不能增大searchRange，也不能从subme 0切换出来，这两项保持预设值。
+ */
+struct X265SpeedLevel
+{
+    int search;
+    int rd;
+    int earlySkip;
+    int rectInter;
+    int merge;
+};
+
+static const X265SpeedLevel kX265SpeedLevels[X2645_SPEED_LEVELS] = {
+    {X265_DIA_SEARCH, 1, 1, 0, 2},
+    {X265_DIA_SEARCH, 2, 1, 0, 2},
+    {X265_HEX_SEARCH, 2, 1, 0, 3},
+    {X265_HEX_SEARCH, 3, 1, 1, 3},
+    {X265_UMH_SEARCH, 4, 0, 1, 4},
+};
+
+// libx265只接受小端平面格式
+static NVIPixelFormat X265NativeFormat(NVIPixelFormat format)
+{
+    switch (format)
+    {
+    case NVIPixel_NV12:
+    case NVIPixel_NV21: return NVIPixel_I420;
+    case NVIPixel_420P10BE: return NVIPixel_420P10LE;
+    case NVIPixel_422P10BE: return NVIPixel_422P10LE;
+    case NVIPixel_V210: return NVIPixel_422P10LE;
+    case NVIPixel_UYVY:
+    case NVIPixel_YUY2: return NVIPixel_422P;
+    default: return format;
+    }
+}
+
 inline X265Encoder::X265Encoder()
     : m_pAPI(nullptr)
     , m_pHandle(nullptr)
     , m_pParam(nullptr)
+    , m_param({})
+    , m_options({})
+    , m_activeOptions({})
+    , m_pSegmentOutput(nullptr)
+    , m_rtp({})
+    , m_szFrameIndex(0u)
+    , m_uThreads(0u)
+    , m_uSliceMode(0u)
+    , m_uSliceCount(1u)
+    , m_bFlushed(false)
+    , m_bForceIntra(false)
+    , m_bIntraRefresh(false)
 {
 }
 
@@ -73,6 +218,7 @@ inline X265Encoder::~X265Encoder()
 
 inline int32_t X265Encoder::Config(const NVIVideoCodecParam& param)
 {
+    TRACE_SCOPE("config", param.width * param.height);
     Release();
     if (param.accel && param.accel->type > NVIAccel_Auto)
     {
@@ -97,12 +243,102 @@ inline int32_t X265Encoder::Config(const NVIVideoCodecParam& param)
             return -4;
         }
     }
+    if (param.slice_mode == 0)
+    {
+        m_uSliceMode = 0u;
+        m_uSliceCount = 1u;
+    }
+    else if (param.slice_mode == NVISliceMode_MultiSlice)
+    {
+        // 默认与x264一致按272行一个slice，x265按CTU行均分slice，slice数不能超过CTU行数
+        const uint32_t uCTURows = (param.height + 63) / 64;
+        uint32_t uSlices = (param.height + kSliceLines - 1) / kSliceLines;
+        if (m_options.slice_layout == X2645SliceLayout_Rows)
+        {
+            const uint32_t uLines = m_options.slice_value * 16u;
+            uSlices = (param.height + uLines - 1) / uLines;
+        }
+        else if (m_options.slice_layout == X2645SliceLayout_Count)
+        {
+            uSlices = m_options.slice_value;
+        }
+        else if (m_options.slice_layout == X2645SliceLayout_MaxBytes)
+        {
+            LOG_WARNING("X265Encoder does not support slice max size, using default slice layout.");
+        }
+        m_uSliceMode = param.slice_mode | NVISliceMode_InOrder;
+        m_uSliceCount = static_cast<uint16_t>(std::max(std::min({uSlices, uCTURows, static_cast<uint32_t>(X2645_MAX_SLICES)}), 1u));
+    }
+    else
+    {
+        return -4;
+    }
+    const bool bThroughput = m_options.tuning == X2645Tuning_Throughput;
+    EncoderPoolEntry entry;
+    if (!bThroughput && EncoderPool::Instance().Take(NVICodec_HEVC, param, m_options, entry))
+    {
+        return Reuse(param, entry);
+    }
+    m_param = param;
     m_pParam = m_pAPI->param_alloc();
     m_pAPI->param_default(m_pParam);
-    m_pAPI->param_default_preset(m_pParam, x265_preset_names[0], x265_tune_names[3]);  // "ultrafast", "zerolatency"
+    if (bThroughput)
+    {
+        m_pAPI->param_default_preset(m_pParam, x265_preset_names[0], nullptr);  // "ultrafast"
+    }
+    else
+    {
+        m_pAPI->param_default_preset(m_pParam, x265_preset_names[0], x265_tune_names[3]);  // "ultrafast", "zerolatency"
+    }
     x265_param& enc = *m_pParam;
+    uint32_t uSlices = m_uSliceCount;
     //* cpuFlags
-    enc.frameNumThreads = 1;  // for ZeroLatency
+    const uint32_t uCores = std::max(std::thread::hardware_concurrency(), 1u);
+    if (bThroughput)
+    {
+        // 帧级多线程 + lookahead + B帧，帧线程数由x265按线程池大小决定
+        enc.frameNumThreads = 0;
+        m_uThreads = WorkerPool::Instance().Acquire(uCores);
+    }
+    else if (m_options.tuning == X2645Tuning_Batch)
+    {
+        // 由批量调度的工作线程驱动，不创建x265线程池，WPP和lookahead在调用线程中串行执行
+        enc.frameNumThreads = 1;
+        enc.lookaheadSlices = 0;
+        m_uThreads = 0u;
+    }
+    else if (m_options.tuning == X2645Tuning_Parallel)
+    {
+        // 单帧内并行：WPP + 多slice + CU级并行分析，仍然每帧一个帧线程，不增加帧延迟
+        enc.frameNumThreads = 1;
+        enc.bEnableWavefront = 1;
+        const uint32_t uCTURows = (param.height + 63) / 64;
+        const uint32_t uCTUCols = (param.width + 63) / 64;
+        if (m_uSliceMode == 0u)
+        {
+            // 每个slice独立开始波前，缩短4K/8K下波前的启动和收尾
+            uSlices = std::max(std::min(uCTURows / kParallelSliceRows, static_cast<uint32_t>(X2645_MAX_SLICES)), 1u);
+        }
+        // 每个slice的波前相邻行相差2个CTU，同时推进的行数不超过列数的一半
+        const uint32_t uWavefront = std::min((uCTURows + uSlices - 1) / uSlices, (uCTUCols + 1) / 2) * uSlices;
+        // 核数多于波前并行度时把CU的模式决策分发到线程池补足并行度，两种情况都按核数申请线程；
+        // 运动估计只在多参考帧时分发，否则开销大于收益
+        const bool bDistribute = uCores > uWavefront;
+        enc.bDistributeModeAnalysis = bDistribute ? 1 : 0;
+        enc.bDistributeMotionEstimation = bDistribute && enc.maxNumReferences > 1 ? 1 : 0;
+        m_uThreads = WorkerPool::Instance().Acquire(uCores);
+        LOG_INFO("X265Encoder parallel mode: {} slices, wavefront {} rows, {} threads, distributed analysis {}.", uSlices, uWavefront, m_uThreads,
+                 bDistribute ? "on" : "off");
+    }
+    else
+    {
+        enc.frameNumThreads = 1;  // for ZeroLatency
+        // 单帧并行只依赖WPP，线程数超过CTU行数没有收益
+        const uint32_t uCTURows = (param.height + 63) / 64;
+        m_uThreads = WorkerPool::Instance().Acquire(std::min(uCTURows, uCores));
+    }
+    m_strPools = m_uThreads > 0u ? WorkerPool::Instance().NumaPools(m_uThreads) : std::string("none");
+    enc.numaPools = m_strPools.c_str();
     //* 视频选项
     enc.sourceWidth = static_cast<int>(param.width);
     enc.sourceHeight = static_cast<int>(param.height);
@@ -129,13 +365,16 @@ inline int32_t X265Encoder::Config(const NVIVideoCodecParam& param)
         }
     }
     //* 流参数
-    enc.bRepeatHeaders = 1;
+    // 带外参数集模式下只能通过encoder_headers()获取VPS/SPS/PPS
+    enc.bRepeatHeaders = m_options.oob_headers != 0u ? 0 : 1;
     enc.bAnnexB = 1;
     enc.bEnableAccessUnitDelimiters = 0;
-    enc.bframes = 0;
-    enc.maxSlices = 1;  // for ZeroLatency
+    enc.bframes = bThroughput ? kThroughputBFrames : 0;
+    enc.maxSlices = static_cast<int>(uSlices);
     enc.keyframeMax = static_cast<int>(param.gop);
     enc.keyframeMin = enc.keyframeMax;
+    // 帧内刷新：keyframeMax为刷新周期，帧内CTU列逐帧移动，避免周期IDR的码率尖峰
+    enc.bIntraRefresh = m_options.intra_refresh != 0u ? 1 : 0;
     enc.fpsNum = param.frame_rate_num;
     enc.fpsDenom = param.frame_rate_den;
     enc.bOpenGOP = 0;
@@ -155,10 +394,20 @@ inline int32_t X265Encoder::Config(const NVIVideoCodecParam& param)
     }
     else
     {
-        enc.rc.vbvBufferSize = static_cast<int>(param.max_bitrate) / enc.fpsNum * enc.fpsDenom * 10;
+        enc.rc.vbvBufferSize = static_cast<int>(static_cast<int64_t>(param.max_bitrate) * enc.fpsDenom * 10 / std::max(enc.fpsNum, 1u));
     }
     enc.rc.aqMode = 0;
-    enc.bDisableLookahead = 1;
+    if (m_options.roi != 0u || m_options.static_qp != 0u)
+    {
+        // quantOffsets只在开启AQ时生效，使用很小的强度只保留外部偏移，偏移按16x16块给出
+        enc.rc.aqMode = X265_AQ_VARIANCE;
+        enc.rc.aqStrength = kQuantMapAqStrength;
+    }
+    enc.bDisableLookahead = bThroughput ? 0 : 1;
+    if (bThroughput)
+    {
+        enc.lookaheadDepth = std::min(kThroughputLookahead, enc.keyframeMax);
+    }
     enc.maxCUSize = 64;
     if (enc.sourceBitDepth == 10)
     {
@@ -169,15 +418,28 @@ inline int32_t X265Encoder::Config(const NVIVideoCodecParam& param)
         m_pAPI->param_apply_profile(&enc, x265_profile_names[0]);  // "main"
     }
     // 打开编码器
-    m_pHandle = m_pAPI->encoder_open(&enc);
+    {
+        WorkerPool::Placement placement;
+        m_pHandle = m_pAPI->encoder_open(&enc);
+    }
     if (m_pHandle)
     {
-        // NAL buffer
-        m_vecStreamBuffer.resize(1ull);
-        for (auto& item : m_vecStreamBuffer)
-        {
-            item.reset(new uint8_t[kBufferSize]);
-        }
+        // 最大延迟帧数: lookahead + B帧 + 帧线程
+        const size_t szDelay = static_cast<size_t>(enc.lookaheadDepth + enc.bframes + kMaxFrameThreads);
+        m_vecFrameInfo.assign(szDelay + 1u, FrameInfo{});
+        m_frameStats.Config(m_options.frame_stats != 0u, szDelay, static_cast<uint32_t>(enc.rc.vbvMaxBitrate), static_cast<uint32_t>(enc.rc.vbvBufferSize),
+                            param.frame_rate_num, param.frame_rate_den);
+        m_szFrameIndex = 0u;
+        m_activeOptions = m_options;
+        m_quantMap.Config(m_options.roi != 0u || m_options.static_qp != 0u, static_cast<uint32_t>(enc.sourceWidth), static_cast<uint32_t>(enc.sourceHeight),
+                          enc.sourceBitDepth > 8 ? 2u : 1u, m_options.static_qp);
+        m_governor.Reset(X2645_SPEED_DEFAULT);
+        m_admission.Reset(param.frame_rate_num, param.frame_rate_den);
+        m_bFlushed = false;
+        m_bForceIntra = false;
+        m_bIntraRefresh = false;
+        BuildHeaders();
+        OpenMuxer();
         LOG_NOTICE("X265Encoder opened handle[{}], libx265 version " LIBX265_VERSION ".", (void*)m_pHandle);
         return 0;
     }
@@ -190,54 +452,380 @@ inline int32_t X265Encoder::Encoding(const NVIVideoImageFrame& in, NVIVideoEncod
     {
         return -1;
     }
+    if (m_bFlushed)
+    {
+        return -3;  // x265冲刷后只接受空帧
+    }
+    TRACE_SCOPE("encode", m_szFrameIndex);
+    const int64_t nBegin = m_governor.Enabled() || m_admission.Enabled() ? SteadyNanoseconds() : 0;
+    // 过载时在转换和编码之前丢弃，请求的关键帧总是编码
+    bool bKeyOnly = false;
+    if (m_admission.Enabled() && !m_admission.Admit(in.info.tick.value, in.info.frame_kind == NVIFrameKind_Intra || m_bForceIntra, nBegin, bKeyOnly))
+    {
+        return 0;
+    }
     x265_picture picIn;
     x265_picture_init(m_pParam, &picIn);
-    if (!PicturePalneCopy(in, picIn))
+    const NVIPixelFormat format = static_cast<NVIPixelFormat>(in.buffer.format);
+    const uint32_t uWidth = static_cast<uint32_t>(m_pParam->sourceWidth);
+    const uint32_t uHeight = static_cast<uint32_t>(m_pParam->sourceHeight);
+    const NVIVideoImageFrame* pFrame = m_converter.Convert(in, uWidth, uHeight, X265NativeFormat(format));
+    if (pFrame == nullptr || !PicturePalneCopy(*pFrame, picIn))
     {
         return -2;
     }
     picIn.pts = static_cast<int64_t>(in.info.tick.value);
     picIn.bitDepth = FormatBitDepth(static_cast<NVIPixelFormat>(in.buffer.format));
-    picIn.sliceType = in.info.frame_kind == NVIFrameKind_Intra ? X265_TYPE_IDR : X265_TYPE_AUTO;
+    // x265在encode中拷贝偏移表
+    picIn.quantOffsets = const_cast<float*>(m_quantMap.Build(pFrame->buffer.planes[0], pFrame->buffer.strides[0]));
+    bool bForceIntra = m_bForceIntra.exchange(false) || bKeyOnly;
+    if (m_bIntraRefresh.exchange(false) && !bForceIntra && m_pAPI->encoder_intra_refresh(m_pHandle) != 0)
+    {
+        bForceIntra = true;
+    }
+    picIn.sliceType = in.info.frame_kind == NVIFrameKind_Intra || bForceIntra ? X265_TYPE_IDR : X265_TYPE_AUTO;
+    // 有延迟帧时输出顺序与输入不同，userData记录输入帧信息的序号
+    const size_t szIndex = m_szFrameIndex++;
+    m_vecFrameInfo[szIndex % m_vecFrameInfo.size()] = in.info;
+    picIn.userData = reinterpret_cast<void*>(szIndex);
+    if (m_frameStats.Enabled())
+    {
+        m_frameStats.Begin();
+        m_frameStats.Submit(szIndex);
+    }
+    const int32_t nResult = EncodeFrame(&picIn, out, user);
+    if (m_admission.Enabled())
+    {
+        m_admission.Finish(SteadyNanoseconds() - nBegin);
+    }
+    if (m_governor.Enabled())
+    {
+        GovernSpeed(nBegin);
+    }
+    return nResult;
+}
+
+inline int32_t X265Encoder::Flush(NVIVideoEncode::OnPacket out, void* user)
+{
+    if (m_pHandle == nullptr)
+    {
+        return -1;
+    }
+    if (m_activeOptions.tuning != X2645Tuning_Throughput)
+    {
+        return 0;  // 没有延迟帧，冲刷会使x265不再接受新的帧
+    }
+    TRACE_SCOPE("flush", 0);
+    if (m_frameStats.Enabled())
+    {
+        m_frameStats.Begin();
+    }
+    m_bFlushed = true;  // x265冲刷后不再接受新的帧
+    int32_t nTotal = 0;
+    int32_t nEncode = 0;
+    while ((nEncode = EncodeFrame(nullptr, out, user)) > 0)
+    {
+        nTotal += nEncode;
+    }
+    m_muxer.Finish();
+    return nEncode < 0 ? nEncode : nTotal;
+}
+
+inline int32_t X265Encoder::EncodeFrame(x265_picture* pic, NVIVideoEncode::OnPacket out, void* user)
+{
     NVIVideoEncodedPacket packet{};
-    packet.info = in.info;
-    packet.pixel_format = in.buffer.format;
-    uint32_t uNal = -1;
+    packet.pixel_format = m_param.format;
+    uint32_t uNal = 0u;
     x265_nal* pNals = nullptr;
     x265_picture picOut{};
-    int nEncode = m_pAPI->encoder_encode(m_pHandle, &pNals, &uNal, &picIn, &picOut);
+    int nEncode = m_pAPI->encoder_encode(m_pHandle, &pNals, &uNal, pic, &picOut);
     if (nEncode > 0 && uNal > 0u)
     {
+        packet.info = m_vecFrameInfo[reinterpret_cast<size_t>(picOut.userData) % m_vecFrameInfo.size()];
         packet.info.frame_kind = X265_TYPE_IDR == picOut.sliceType || X265_TYPE_I == picOut.sliceType ? NVIFrameKind_Intra : NVIFrameKind_Delta;
-        uint8_t* pData = m_vecStreamBuffer[0].get();
+        packet.slice_mode = 0;
+        packet.slice_count = 1;
+        packet.slice_offset = 0;
+        packet.slice_number = 1;
+    }
+    const bool bSliceOutput = m_uSliceCount > 1u && (out || m_rtp.out);
+    if (nEncode > 0 && uNal > 0u && m_frameStats.Enabled() && !bSliceOutput)
+    {
+        FinishFrameStats(picOut, packet, pNals, uNal);
+    }
+    if (nEncode > 0 && uNal > 0u && bSliceOutput)
+    {
+        SliceOutput(pNals, uNal, packet, out, user);
+        if (m_frameStats.Enabled())
+        {
+            FinishFrameStats(picOut, packet, pNals, uNal);
+        }
+    }
+    else if (nEncode > 0 && uNal > 0u && m_rtp.out)
+    {
+        RtpOutput(pNals, uNal, packet, true);
+    }
+    else if (nEncode > 0 && uNal > 0u && m_pSegmentOutput)
+    {
+        m_vecSegments.resize(uNal);
+        packet.buffer.size = 0ull;
+        for (uint32_t i = 0; i < uNal; ++i)
+        {
+            X2645NalSegment& segment = m_vecSegments[i];
+            segment.bytes = pNals[i].payload;
+            segment.size = static_cast<size_t>(pNals[i].sizeBytes);
+            segment.nal_type = pNals[i].type;
+            packet.buffer.size += segment.size;
+        }
+        packet.buffer.bytes = nullptr;
+        TRACE_SCOPE("output", packet.buffer.size);
+        m_pSegmentOutput(&packet, m_vecSegments.data(), uNal, user);
+    }
+    else if (nEncode > 0 && uNal > 0u && out)
+    {
         size_t& szData = packet.buffer.size;
         szData = 0ull;
-        for (int i = 0; i < uNal; ++i)
+        for (uint32_t i = 0; i < uNal; ++i)
         {
-            if (szData + pNals[i].sizeBytes > kBufferSize)
-            {
-                m_pAPI->encoder_intra_refresh(m_pHandle);
-                LOG_ERROR("The x265 encoded nal size overflow");
-                return -3;
-            }
-            else
+            szData += static_cast<size_t>(pNals[i].sizeBytes);
+        }
+        uint8_t* pData = m_streamBuffer.Reserve(szData);
+        szData = 0ull;
+        {
+            TRACE_SCOPE("copy", nEncode);
+            for (uint32_t i = 0; i < uNal; ++i)
             {
                 memcpy(pData + szData, pNals[i].payload, pNals[i].sizeBytes);
                 szData += static_cast<size_t>(pNals[i].sizeBytes);
             }
         }
+        m_streamBuffer.Commit(szData);
         packet.buffer.bytes = pData;
-        packet.slice_mode = 0;
-        packet.slice_count = 1;
-        packet.slice_offset = 0;
-        packet.slice_number = 1;
+        TRACE_SCOPE("output", szData);
         out(&packet, user);
     }
+    if (nEncode > 0 && uNal > 0u && m_muxer.Opened())
+    {
+        TRACE_SCOPE("mux", uNal);
+        const size_t szIndex = reinterpret_cast<size_t>(picOut.userData);
+        m_muxer.BeginFrame(X265_TYPE_IDR == picOut.sliceType, static_cast<int64_t>(szIndex), m_vecFrameInfo[szIndex % m_vecFrameInfo.size()].tick.value);
+        for (uint32_t i = 0; i < uNal; ++i)
+        {
+            m_muxer.AddNal(pNals[i].payload, static_cast<size_t>(pNals[i].sizeBytes));
+        }
+        m_muxer.EndFrame();
+    }
     return nEncode;
 }
 
+inline void X265Encoder::SliceOutput(const x265_nal* pNals, uint32_t uNal, NVIVideoEncodedPacket& packet, NVIVideoEncode::OnPacket out, void* user)
+{
+    /*
+     * x265编码完整帧后一次返回所有NAL，按顺序拆分为逐Slice的数据包:
+     * VPS/SPS/PPS/前缀SEI并入第一个slice，后缀SEI并入最后一个slice。
+     * x265的NAL在同一块连续内存中，合并的NAL地址相邻时直接引用，否则拷贝。
+     */
+    uint32_t uSlices = 0u;
+    for (uint32_t i = 0; i < uNal; ++i)
+    {
+        if (pNals[i].type < NAL_UNIT_VPS)
+        {
+            ++uSlices;
+        }
+    }
+    packet.slice_mode = m_uSliceMode;
+    packet.slice_count = static_cast<uint16_t>(uSlices);
+    packet.slice_number = 1;
+    uint16_t uOffset = 0u;
+    uint32_t uBegin = 0u;
+    for (uint32_t i = 0; i < uNal; ++i)
+    {
+        if (pNals[i].type >= NAL_UNIT_VPS)
+        {
+            continue;
+        }
+        uint32_t uEnd = i + 1;
+        if (uOffset + 1u == uSlices)
+        {
+            uEnd = uNal;
+        }
+        bool bContiguous = true;
+        size_t szData = 0ull;
+        for (uint32_t n = uBegin; n < uEnd; ++n)
+        {
+            if (n > uBegin && pNals[n - 1].payload + pNals[n - 1].sizeBytes != pNals[n].payload)
+            {
+                bContiguous = false;
+            }
+            szData += static_cast<size_t>(pNals[n].sizeBytes);
+        }
+        if (m_rtp.out)
+        {
+            packet.slice_offset = uOffset++;
+            if (m_frameStats.Enabled())
+            {
+                m_frameStats.OnSlice(packet.slice_offset, szData);
+            }
+            RtpOutput(pNals + uBegin, uEnd - uBegin, packet, uOffset == uSlices);
+            uBegin = uEnd;
+            continue;
+        }
+        if (bContiguous)
+        {
+            packet.buffer.bytes = pNals[uBegin].payload;
+        }
+        else
+        {
+            TRACE_SCOPE("copy", szData);
+            uint8_t* pData = m_streamBuffer.Reserve(szData);
+            szData = 0ull;
+            for (uint32_t n = uBegin; n < uEnd; ++n)
+            {
+                memcpy(pData + szData, pNals[n].payload, pNals[n].sizeBytes);
+                szData += static_cast<size_t>(pNals[n].sizeBytes);
+            }
+            m_streamBuffer.Commit(szData);
+            packet.buffer.bytes = pData;
+        }
+        packet.buffer.size = szData;
+        packet.slice_offset = uOffset++;
+        if (m_frameStats.Enabled())
+        {
+            m_frameStats.OnSlice(packet.slice_offset, szData);
+        }
+        TRACE_SCOPE("output", szData);
+        out(&packet, user);
+        uBegin = uEnd;
+    }
+}
+
+inline void X265Encoder::RtpOutput(const x265_nal* pNals, uint32_t uNal, NVIVideoEncodedPacket& packet, bool marker)
+{
+    m_rtpPacketizer.Reset();
+    for (uint32_t i = 0; i < uNal; ++i)
+    {
+        m_rtpPacketizer.Add(pNals[i].payload, static_cast<size_t>(pNals[i].sizeBytes));
+    }
+    const uint32_t uCount = m_rtpPacketizer.Finish(marker);
+    packet.buffer.bytes = nullptr;
+    packet.buffer.size = m_rtpPacketizer.Bytes();
+    TRACE_SCOPE("output", packet.buffer.size);
+    m_rtp.out(&packet, m_rtpPacketizer.Payloads(), uCount, m_rtp.user);
+}
+
+inline void X265Encoder::FinishFrameStats(const x265_picture& picOut, const NVIVideoEncodedPacket& packet, const x265_nal* pNals, uint32_t uNal)
+{
+    size_t szBytes = 0ull;
+    for (uint32_t i = 0; i < uNal; ++i)
+    {
+        szBytes += static_cast<size_t>(pNals[i].sizeBytes);
+    }
+    // x265输出的bufferFill单位为bit
+    double dVbvFill = -1.0;
+    if (m_pParam->rc.vbvBufferSize > 0)
+    {
+        dVbvFill = picOut.frameData.bufferFill / (m_pParam->rc.vbvBufferSize * 1000.0);
+    }
+    const size_t szIndex = reinterpret_cast<size_t>(picOut.userData);
+    m_frameStats.Finish(szIndex, packet.info.tick.value, X265FrameType(picOut.sliceType), static_cast<float>(picOut.frameData.qp), szBytes, dVbvFill);
+}
+
+inline int32_t X265Encoder::Reuse(const NVIVideoCodecParam& param, EncoderPoolEntry& entry)
+{
+    m_pAPI = static_cast<const x265_api*>(entry.api);
+    m_pHandle = static_cast<x265_encoder*>(entry.handle);
+    m_pParam = static_cast<x265_param*>(entry.context);
+    m_strPools = std::move(entry.pools);
+    m_pParam->numaPools = m_strPools.c_str();
+    m_uThreads = entry.threads;
+    m_param = param;
+    const size_t szDelay = static_cast<size_t>(m_pParam->lookaheadDepth + m_pParam->bframes + kMaxFrameThreads);
+    m_vecFrameInfo.assign(szDelay + 1u, FrameInfo{});
+    m_frameStats.Config(m_options.frame_stats != 0u, szDelay, static_cast<uint32_t>(m_pParam->rc.vbvMaxBitrate),
+                        static_cast<uint32_t>(m_pParam->rc.vbvBufferSize), param.frame_rate_num, param.frame_rate_den);
+    m_szFrameIndex = 0u;
+    m_activeOptions = m_options;
+    m_quantMap.Config(m_options.roi != 0u || m_options.static_qp != 0u, static_cast<uint32_t>(m_pParam->sourceWidth),
+                      static_cast<uint32_t>(m_pParam->sourceHeight), m_pParam->sourceBitDepth > 8 ? 2u : 1u, m_options.static_qp);
+    m_governor.Reset(X2645_SPEED_DEFAULT);  // 放回缓存前已恢复默认级别
+    m_admission.Reset(param.frame_rate_num, param.frame_rate_den);
+    m_bFlushed = false;
+    m_bForceIntra = true;  // 参考帧属于上一个使用者
+    m_bIntraRefresh = false;
+    BuildHeaders();
+    OpenMuxer();
+    LOG_INFO("X265Encoder reused handle[{}].", (void*)m_pHandle);
+    return 0;
+}
+
+inline void X265Encoder::BuildHeaders()
+{
+    m_headers.Reset(NVICodec_HEVC);
+    uint32_t uNal = 0u;
+    x265_nal* pNals = nullptr;
+    if (m_pAPI->encoder_headers(m_pHandle, &pNals, &uNal) > 0)
+    {
+        for (uint32_t i = 0; i < uNal; ++i)
+        {
+            m_headers.Add(pNals[i].payload, static_cast<size_t>(pNals[i].sizeBytes));
+        }
+    }
+    if (!m_headers.Build())
+    {
+        LOG_WARNING("X265Encoder handle[{}] failed to build hvcC.", (void*)m_pHandle);
+    }
+}
+
+inline bool X265Encoder::OpenMuxer()
+{
+    X2645StreamHeaders headers{};
+    if (!m_muxer.Configured() || !m_headers.Query(headers))
+    {
+        return false;
+    }
+    const uint32_t uDelay = m_pParam->bframes > 0 ? (m_pParam->bBPyramid != 0 ? 2u : 1u) : 0u;
+    return m_muxer.Open(m_param, uDelay, m_pParam->bRepeatHeaders != 0, headers);
+}
+
+inline void X265Encoder::ClosePooled(EncoderPoolEntry& entry)
+{
+    const x265_api* pAPI = static_cast<const x265_api*>(entry.api);
+    pAPI->encoder_close(static_cast<x265_encoder*>(entry.handle));
+    pAPI->param_free(static_cast<x265_param*>(entry.context));
+    WorkerPool::Instance().Release(entry.threads);
+    entry.handle = nullptr;
+    entry.context = nullptr;
+    entry.threads = 0u;
+}
+
 inline void X265Encoder::Release()
 {
+    m_muxer.Finish();
+    // 未冲刷过的ZeroLatency/Batch编码器没有延迟帧，可以留给相同配置的实例复用
+    if (m_pHandle && m_activeOptions.tuning != X2645Tuning_Throughput && !m_bFlushed)
+    {
+        if (m_governor.Level() != X2645_SPEED_DEFAULT)
+        {
+            ApplySpeedLevel(X2645_SPEED_DEFAULT);
+        }
+        EncoderPoolEntry entry;
+        entry.codec = NVICodec_HEVC;
+        entry.param = m_param;
+        entry.options = m_activeOptions;
+        entry.handle = m_pHandle;
+        entry.api = m_pAPI;
+        entry.context = m_pParam;
+        entry.pools = m_strPools;
+        entry.threads = m_uThreads;
+        entry.close = &X265Encoder::ClosePooled;
+        if (EncoderPool::Instance().Put(entry))
+        {
+            m_pHandle = nullptr;
+            m_pParam = nullptr;
+            m_pAPI = nullptr;
+            m_uThreads = 0u;
+        }
+    }
     if (m_pAPI)
     {
         if (m_pHandle)
@@ -252,6 +840,195 @@ inline void X265Encoder::Release()
         }
         m_pAPI = nullptr;
     }
+    m_streamBuffer.Reset();
+    WorkerPool::Instance().Release(m_uThreads);
+    m_uThreads = 0u;
+}
+
+inline int32_t X265Encoder::Reconfig(const NVIVideoCodecParam& param, uint32_t fields, uint32_t& rejected)
+{
+    rejected = 0u;
+    if (m_pHandle == nullptr)
+    {
+        return -1;
+    }
+    // x265不支持在线修改帧率，打开时未启用VBV则不能在线开启，也不能在线关闭；CRF下不使用平均码率
+    x265_param& enc = *m_pParam;
+    const bool bVbv = enc.rc.vbvMaxBitrate > 0 && enc.rc.vbvBufferSize > 0;
+    rejected |= fields & X2645Reconfig_FrameRate;
+    if (!bVbv)
+    {
+        rejected |= fields & (X2645Reconfig_MaxBitrate | X2645Reconfig_Vbv);
+    }
+    else if (param.max_bitrate == 0u)
+    {
+        rejected |= fields & X2645Reconfig_MaxBitrate;
+    }
+    if (enc.rc.rateControlMode == X265_RC_CRF)
+    {
+        rejected |= fields & X2645Reconfig_AvgBitrate;
+    }
+    fields &= ~rejected;
+    if (fields == 0u)
+    {
+        return 0;
+    }
+    x265_param previous = enc;
+    if (fields & X2645Reconfig_AvgBitrate)
+    {
+        enc.rc.bitrate = static_cast<int>(param.avg_bitrate);
+    }
+    if (fields & X2645Reconfig_Quality)
+    {
+        enc.rc.rfConstant = param.quality > 0 && param.quality <= 51 ? static_cast<float>(param.quality) : previous.rc.rfConstant;
+    }
+    if (fields & X2645Reconfig_MaxBitrate)
+    {
+        enc.rc.vbvMaxBitrate = static_cast<int>(param.max_bitrate);
+    }
+    // vbv为0时与打开时一致，按最大码率计算
+    if ((fields & X2645Reconfig_Vbv) || ((fields & X2645Reconfig_MaxBitrate) && m_param.vbv == 0u))
+    {
+        if ((fields & X2645Reconfig_Vbv) && param.vbv > 0)
+        {
+            enc.rc.vbvBufferSize = static_cast<int>(param.vbv);
+        }
+        else
+        {
+            enc.rc.vbvBufferSize = static_cast<int>(static_cast<int64_t>(enc.rc.vbvMaxBitrate) * enc.fpsDenom * 10 / std::max(enc.fpsNum, 1u));
+        }
+    }
+    if (m_pAPI->encoder_reconfig(m_pHandle, &enc) < 0)
+    {
+        enc = previous;
+        rejected |= fields;
+        return -3;
+    }
+    m_param.avg_bitrate = (fields & X2645Reconfig_AvgBitrate) ? param.avg_bitrate : m_param.avg_bitrate;
+    m_param.max_bitrate = (fields & X2645Reconfig_MaxBitrate) ? param.max_bitrate : m_param.max_bitrate;
+    m_param.vbv = (fields & X2645Reconfig_Vbv) ? param.vbv : m_param.vbv;
+    m_param.quality = (fields & X2645Reconfig_Quality) ? param.quality : m_param.quality;
+    m_frameStats.ConfigVbv(static_cast<uint32_t>(enc.rc.vbvMaxBitrate), static_cast<uint32_t>(enc.rc.vbvBufferSize), m_param.frame_rate_num,
+                           m_param.frame_rate_den);
+    return 0;
+}
+
+inline int32_t X265Encoder::IntraRefresh()
+{
+    if (m_pHandle == nullptr)
+    {
+        return -1;
+    }
+    // encoder_intra_refresh不能与encode同时调用，留到编码线程中执行，失败时改为IDR
+    if (m_activeOptions.intra_refresh != 0u)
+    {
+        m_bIntraRefresh = true;
+        return 0;
+    }
+    m_bForceIntra = true;
+    return 1;
+}
+
+inline void X265Encoder::SetOptions(const X2645EncodeOptions& options)
+{
+    m_options = options;
+}
+
+inline void X265Encoder::SetSegmentOutput(X2645OnSegments out)
+{
+    m_pSegmentOutput = out;
+}
+
+inline void X265Encoder::SetRtpOutput(const X2645RtpConfig& config)
+{
+    m_rtp = config;
+    if (m_rtp.out)
+    {
+        m_rtpPacketizer.Config(NVICodec_HEVC, m_rtp.mtu);
+    }
+}
+
+inline int32_t X265Encoder::SetMuxOutput(const X2645MuxConfig* config)
+{
+    m_muxer.Config(config);
+    if (m_pHandle && m_muxer.Configured())
+    {
+        return OpenMuxer() ? 0 : -2;
+    }
+    return 0;
+}
+
+inline int32_t X265Encoder::SetRoi(const X2645RoiRegion* regions, uint32_t count)
+{
+    if (!m_quantMap.Enabled())
+    {
+        return -2;
+    }
+    m_quantMap.SetRegions(regions, count);
+    return 0;
+}
+
+inline int32_t X265Encoder::SetSpeedGovernor(const X2645SpeedGovernorConfig* config)
+{
+    m_governor.Config(config);
+    if (config == nullptr && m_governor.Level() != X2645_SPEED_DEFAULT)
+    {
+        if (m_pHandle && !ApplySpeedLevel(X2645_SPEED_DEFAULT))
+        {
+            return -3;
+        }
+        m_governor.Reset(X2645_SPEED_DEFAULT);
+    }
+    return 0;
+}
+
+inline void X265Encoder::SetAdmission(const X2645AdmissionConfig* config)
+{
+    m_admission.Config(config);
+    m_admission.Reset(m_param.frame_rate_num, m_param.frame_rate_den);
+}
+
+inline bool X265Encoder::ApplySpeedLevel(uint32_t level)
+{
+    const X265SpeedLevel& speed = kX265SpeedLevels[level];
+    x265_param& enc = *m_pParam;
+    x265_param previous = enc;
+    enc.searchMethod = speed.search;
+    enc.rdLevel = speed.rd;
+    enc.bEnableEarlySkip = speed.earlySkip;
+    enc.bEnableRectInter = speed.rectInter;
+    enc.maxNumMergeCand = speed.merge;
+    if (m_pAPI->encoder_reconfig(m_pHandle, &enc) < 0)
+    {
+        enc = previous;
+        return false;
+    }
+    return true;
+}
+
+inline void X265Encoder::GovernSpeed(int64_t begin)
+{
+    uint32_t uLevel = 0u;
+    if (!m_governor.Update(SteadyNanoseconds() - begin, m_param.frame_rate_num, m_param.frame_rate_den, uLevel))
+    {
+        return;
+    }
+    if (ApplySpeedLevel(uLevel))
+    {
+        m_governor.Commit(uLevel);
+    }
+    else
+    {
+        LOG_WARNING("X265Encoder reconfig speed level {} failed, governor stopped.", uLevel);
+        m_governor.Config(nullptr);
+    }
+}
+
+inline void X265Encoder::GetBufferStats(X2645BufferStats& stats) const
+{
+    stats.capacity = m_streamBuffer.Capacity();
+    stats.high_water = m_streamBuffer.HighWater();
+    stats.pooled = StreamBufferPool::Instance().PooledBytes();
 }
 
 inline bool X265Encoder::PicturePalneCopy(const NVIVideoImageFrame& in, x265_picture& out)
@@ -0,0 +1,134 @@
+﻿#include "AsyncLogSink.h"
+#include <chrono>
+#include <cstring>
+#include <string>
+
+AsyncLogSink& AsyncLogSink::Instance()
+{
+    static AsyncLogSink s_sink;
+    return s_sink;
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+    Stop();
+}
+
+bool AsyncLogSink::Start(uint32_t capacity, Output output)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_bRunning.load(std::memory_order_acquire) || output == nullptr)
+    {
+        return m_bRunning.load(std::memory_order_acquire);
+    }
+    if (!m_pSlots)
+    {
+        size_t szCapacity = 1u;
+        while (szCapacity < (capacity > 0u ? capacity : kDefaultCapacity))
+        {
+            szCapacity <<= 1;
+        }
+        m_pSlots.reset(new Slot[szCapacity]);
+        for (size_t i = 0; i < szCapacity; ++i)
+        {
+            m_pSlots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_szMask = szCapacity - 1u;
+    }
+    m_pOutput = output;
+    m_bRunning.store(true, std::memory_order_release);
+    m_thread = std::thread(&AsyncLogSink::Drain, this);
+    return true;
+}
+
+void AsyncLogSink::Stop()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_bRunning.exchange(false, std::memory_order_acq_rel))
+        {
+            return;
+        }
+        thread = std::move(m_thread);
+    }
+    m_condition.notify_one();
+    thread.join();
+}
+
+bool AsyncLogSink::Push(uint32_t level, const char* message, size_t length)
+{
+    size_t szPos = m_szEnqueue.load(std::memory_order_relaxed);
+    Slot* pSlot = nullptr;
+    while (true)
+    {
+        pSlot = &m_pSlots[szPos & m_szMask];
+        const size_t szSequence = pSlot->sequence.load(std::memory_order_acquire);
+        const intptr_t nDiff = static_cast<intptr_t>(szSequence) - static_cast<intptr_t>(szPos);
+        if (nDiff == 0)
+        {
+            if (m_szEnqueue.compare_exchange_weak(szPos, szPos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (nDiff < 0)
+        {
+            m_uDropped.fetch_add(1u, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            szPos = m_szEnqueue.load(std::memory_order_relaxed);
+        }
+    }
+    pSlot->level = level;
+    pSlot->length = static_cast<uint32_t>(length < kMessageBytes ? length : kMessageBytes - 1);
+    memcpy(pSlot->message, message, pSlot->length);
+    pSlot->message[pSlot->length] = '\0';
+    pSlot->sequence.store(szPos + 1, std::memory_order_release);
+    if (m_bSleeping.load(std::memory_order_acquire))
+    {
+        m_condition.notify_one();
+    }
+    return true;
+}
+
+void AsyncLogSink::Drain()
+{
+    while (true)
+    {
+        bool bRunning = m_bRunning.load(std::memory_order_acquire);
+        size_t szCount = 0u;
+        while (true)
+        {
+            Slot& slot = m_pSlots[m_szDequeue & m_szMask];
+            if (slot.sequence.load(std::memory_order_acquire) != m_szDequeue + 1)
+            {
+                break;
+            }
+            m_pOutput(slot.level, slot.message, slot.length);
+            slot.sequence.store(m_szDequeue + m_szMask + 1, std::memory_order_release);
+            ++m_szDequeue;
+            ++szCount;
+        }
+        const uint64_t uDropped = m_uDropped.exchange(0u, std::memory_order_relaxed);
+        if (uDropped > 0u)
+        {
+            const std::string strMessage = "#X2645 async logging dropped " + std::to_string(uDropped) + " messages.";
+            m_pOutput(4u, strMessage.c_str(), strMessage.size());
+        }
+        if (!bRunning)
+        {
+            break;
+        }
+        if (szCount == 0u)
+        {
+            // 生产者只在消费者休眠时唤醒，超时兜底错过的通知
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_bSleeping.store(true, std::memory_order_release);
+            m_condition.wait_for(lock, std::chrono::milliseconds(20));
+            m_bSleeping.store(false, std::memory_order_release);
+        }
+    }
+}
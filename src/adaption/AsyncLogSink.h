@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+ * 异步日志：多生产者单消费者的有界无锁环形队列(按序号交接槽位)，
+ * 编码线程只做一次拷贝，队列满时丢弃并计数，不会阻塞；后台线程按顺序调用输出函数。
+ */
+class AsyncLogSink final
+{
+public:
+    typedef void (*Output)(uint32_t level, const char* message, size_t length);
+
+    static AsyncLogSink& Instance();
+
+public:
+    // 队列容量只在第一次启动时生效
+    bool Start(uint32_t capacity, Output output);
+    void Stop();
+    bool Running() const { return m_bRunning.load(std::memory_order_acquire); }
+    bool Push(uint32_t level, const char* message, size_t length);
+
+private:
+    AsyncLogSink() = default;
+    ~AsyncLogSink();
+    void Drain();
+
+private:
+    static constexpr size_t kMessageBytes = 512u;
+    static constexpr uint32_t kDefaultCapacity = 1024u;
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        uint32_t level;
+        uint32_t length;
+        char message[kMessageBytes];
+    };
+
+    std::unique_ptr<Slot[]> m_pSlots;
+    size_t m_szMask = 0u;
+    alignas(64) std::atomic<size_t> m_szEnqueue{0u};
+    alignas(64) size_t m_szDequeue = 0u;
+    std::atomic<uint64_t> m_uDropped{0u};
+    std::atomic<bool> m_bRunning{false};
+    std::atomic<bool> m_bSleeping{false};
+    Output m_pOutput = nullptr;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::thread m_thread;
+};
@@ -1,16 +1,66 @@
 ﻿#include "Logging.h"
+#include "AsyncLogSink.h"
 
-static logging s_pLogging = nullptr;
+static std::atomic<logging> s_pLogging{nullptr};
+static std::atomic<int32_t> s_nLevel{static_cast<int32_t>(LogLevel::DEBUG)};
+std::atomic<int32_t> g_nLoggingLevel{-1};
+
+static void UpdateLoggingLevel()
+{
+    g_nLoggingLevel.store(s_pLogging.load() ? s_nLevel.load() : -1, std::memory_order_relaxed);
+}
+
+static void AsyncOutput(uint32_t level, const char* message, size_t length)
+{
+    logging pLogging = s_pLogging.load(std::memory_order_acquire);
+    if (pLogging)
+    {
+        pLogging(static_cast<int>(level), message, static_cast<unsigned int>(length));
+    }
+}
 
 void SetLoggingFunc(logging func)
 {
     s_pLogging = func;
+    UpdateLoggingLevel();
+}
+
+void SetLoggingLevel(int32_t level)
+{
+    s_nLevel = level;
+    UpdateLoggingLevel();
+}
+
+int32_t LoggingLevel()
+{
+    return g_nLoggingLevel.load(std::memory_order_relaxed);
+}
+
+bool SetLoggingAsync(bool enable, uint32_t capacity)
+{
+    if (enable)
+    {
+        return AsyncLogSink::Instance().Start(capacity, &AsyncOutput);
+    }
+    AsyncLogSink::Instance().Stop();
+    return true;
 }
 
 void LoggingOut(LogLevel level, const std::string& message)
 {
-    if (s_pLogging)
+    LoggingOut(level, message.c_str(), message.size());
+}
+
+void LoggingOut(LogLevel level, const char* message, size_t length)
+{
+    if (AsyncLogSink::Instance().Running())
+    {
+        AsyncLogSink::Instance().Push(static_cast<uint32_t>(level), message, length);
+        return;
+    }
+    logging pLogging = s_pLogging.load(std::memory_order_acquire);
+    if (pLogging)
     {
-        s_pLogging(static_cast<int>(level), message.c_str(), static_cast<unsigned int>(message.size()));
+        pLogging(static_cast<int>(level), message, static_cast<unsigned int>(length));
     }
 }
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <cassert>
 #include <string>
@@ -20,7 +21,21 @@ enum class LogLevel : uint32_t
 
 typedef void (*logging)(int level, const char* message, unsigned int length);
 void SetLoggingFunc(logging func);
+// 级别数值大于level的日志在格式化之前丢弃，小于0关闭日志
+void SetLoggingLevel(int32_t level);
+int32_t LoggingLevel();
+// 异步输出：日志写入无锁环形队列，由后台线程调用日志回调
+bool SetLoggingAsync(bool enable, uint32_t capacity);
 void LoggingOut(LogLevel level, const std::string& message);
+void LoggingOut(LogLevel level, const char* message, size_t length);
+
+// 生效的日志级别，未设置回调时为-1
+extern std::atomic<int32_t> g_nLoggingLevel;
+
+inline bool LoggingEnabled(LogLevel level)
+{
+    return static_cast<int32_t>(level) <= g_nLoggingLevel.load(std::memory_order_relaxed);
+}
 
 #ifdef _HAS_FMT
 #include <fmt/core.h>
@@ -32,10 +47,17 @@ void LoggingOut(LogLevel level, const std::string& message);
 template <typename... Args>
 inline void LoggingMessage(LogLevel level, const char* fmt, Args&&... args)
 {
+    if (!LoggingEnabled(level))
+    {
+        return;
+    }
     try
     {
-        const std::string strMessage = fmt::format(fmt, args...);
-        LoggingOut(level, strMessage);
+        // 格式化到栈上缓存，超过500字节时才分配内存
+        fmt::memory_buffer buffer;
+        fmt::format_to(std::back_inserter(buffer), fmt, args...);
+        buffer.push_back('\0');
+        LoggingOut(level, buffer.data(), buffer.size() - 1);
     }
     catch (const fmt::format_error& e)
     {
@@ -0,0 +1,92 @@
+﻿#include "Trace.h"
+#ifdef X2645_TRACE
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static constexpr size_t kTraceEvents = 16384u;  // 每个线程保留的事件数
+
+struct TraceEvent
+{
+    const char* name;
+    int64_t begin;
+    int64_t duration;
+    int64_t arg;
+};
+
+// 只有所属线程写入，互斥量只在输出时发生竞争
+struct TraceRing
+{
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    size_t written = 0u;
+    uint32_t tid = 0u;
+};
+
+static std::mutex s_mutex;
+static std::vector<std::shared_ptr<TraceRing>> s_vecRings;  // 线程退出后保留，输出时仍可读取
+
+static TraceRing& LocalRing()
+{
+    thread_local std::shared_ptr<TraceRing> t_pRing;
+    if (!t_pRing)
+    {
+        t_pRing = std::make_shared<TraceRing>();
+        t_pRing->events.resize(kTraceEvents);
+        std::lock_guard<std::mutex> lock(s_mutex);
+        t_pRing->tid = static_cast<uint32_t>(s_vecRings.size() + 1u);
+        s_vecRings.push_back(t_pRing);
+    }
+    return *t_pRing;
+}
+
+void TraceRecord(const char* name, int64_t begin, int64_t duration, int64_t arg)
+{
+    TraceRing& ring = LocalRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.events[ring.written % kTraceEvents] = {name, begin, duration, arg};
+    ++ring.written;
+}
+
+int32_t TraceDump(const char* path)
+{
+    FILE* pFile = fopen(path, "w");
+    if (pFile == nullptr)
+    {
+        return -1;
+    }
+    std::vector<std::shared_ptr<TraceRing>> vecRings;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        vecRings = s_vecRings;
+    }
+    // Chrome trace的时间单位为微秒
+    int32_t nEvents = 0;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", pFile);
+    std::vector<TraceEvent> vecEvents;
+    for (const auto& pRing : vecRings)
+    {
+        size_t szWritten = 0u;
+        {
+            std::lock_guard<std::mutex> lock(pRing->mutex);
+            vecEvents = pRing->events;
+            szWritten = pRing->written;
+        }
+        // 从最旧的事件开始输出
+        const size_t szCount = szWritten < kTraceEvents ? szWritten : kTraceEvents;
+        for (size_t i = szWritten - szCount; i < szWritten; ++i)
+        {
+            const TraceEvent& event = vecEvents[i % kTraceEvents];
+            fprintf(pFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%lld}}", nEvents > 0 ? "," : "",
+                    event.name, pRing->tid, static_cast<double>(event.begin) / 1000.0, static_cast<double>(event.duration) / 1000.0,
+                    static_cast<long long>(event.arg));
+            ++nEvents;
+        }
+    }
+    fputs("]}\n", pFile);
+    const bool bFailed = ferror(pFile) != 0;
+    fclose(pFile);
+    return bFailed ? -1 : nEvents;
+}
+#endif
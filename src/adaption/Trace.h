@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <cstdint>
+
+/*
+ * 热路径追踪：定义X2645_TRACE编译时生效，未定义时TRACE_SCOPE展开为空，没有任何开销。
+ * 开启后每个线程把区间事件写入自己的环形缓冲(写满覆盖最旧的事件)，`TraceDump`输出Chrome trace JSON；
+ * 系统提供<sys/sdt.h>时同时生成USDT探针x2645:begin(name, arg)和x2645:end(name, arg, ns)，供perf/bpftrace挂载。
+ */
+#ifdef X2645_TRACE
+#include "Clock.h"
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define X2645_TRACE_SDT 1
+#endif
+#endif
+
+// name必须是字符串常量，输出时才读取
+void TraceRecord(const char* name, int64_t begin, int64_t duration, int64_t arg);
+// 输出所有线程缓冲中的事件，返回事件数，文件无法写入返回-1
+int32_t TraceDump(const char* path);
+
+class TraceScope final
+{
+public:
+    TraceScope(const char* name, int64_t arg)
+        : m_name(name)
+        , m_arg(arg)
+        , m_begin(SteadyNanoseconds())
+    {
+#ifdef X2645_TRACE_SDT
+        DTRACE_PROBE2(x2645, begin, m_name, m_arg);
+#endif
+    }
+    ~TraceScope()
+    {
+        const int64_t nDuration = SteadyNanoseconds() - m_begin;
+#ifdef X2645_TRACE_SDT
+        DTRACE_PROBE3(x2645, end, m_name, m_arg, nDuration);
+#endif
+        TraceRecord(m_name, m_begin, nDuration, m_arg);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    int64_t m_arg;
+    int64_t m_begin;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// 记录从此处到所在作用域结束的区间
+#define TRACE_SCOPE(name, arg) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, static_cast<int64_t>(arg))
+#else
+#define TRACE_SCOPE(name, arg) ((void)0)
+#endif